@@ -9,255 +9,596 @@
 #include "OSFS.h"
 
 const int DELBIT = 7;
+const int WRAPBIT = 6;
 
-uint16_t startOfEEPROM = 1;
-uint16_t endOfEEPROM = 4096;
+// The backend in use and its range, set by useBackend()
+static const osfsBackend* backend = NULL;
 
-void readNBytes(uint16_t address, unsigned int num, byte* output) {
-    eeprom_read_block((void*) output, (const void*) address, num);
-}
+uint16_t startOfEEPROM = 0;
+uint16_t endOfEEPROM = 0;
 
-void writeNBytes(uint16_t address, unsigned int num, const byte* input) {
-    eeprom_update_block((const void*) input, (void*) address, num);
-}
+// In-RAM index of the live files, built when the volume is mounted.
+// Slots are probed linearly from the hash of the file ID and hold the
+// address of the file's header, INDEX_EMPTY or INDEX_REMOVED.
+#define INDEX_EMPTY   0
+#define INDEX_REMOVED 0xFFFF
+
+typedef struct indexEntry {
+    uint16_t fileID;
+    uint16_t address;
+} indexEntry;
+
+static indexEntry fileIndex[OSFS_INDEX_SIZE];
+
+typedef enum {
+    INDEX_UNBUILT = 0,
+    INDEX_BUILT,
+    INDEX_OVERFLOWED
+} indexState;
+
+static indexState fileIndexState = INDEX_UNBUILT;
+
+static uint8_t indexSlot(uint16_t fileID);
+static void indexInsert(uint16_t fileID, uint16_t headerAddress);
+static void indexRemove(uint16_t headerAddress);
+static result indexLookup(uint16_t fileID, uint16_t* headerAddress, fileHeader* header);
+static result findFile(const osfsVolume* vol, uint16_t fileID, uint16_t* headerAddress, fileHeader* header);
+static result setNextFile(uint16_t headerAddress, uint16_t nextFile);
+static result finishCompaction(osfsVolume* vol);
+
+static uint8_t indexHasRoom();
 
-result getFileInfo(const char* filename, uint16_t* filePointer, uint16_t* fileSize) {
+// Log volumes
+static result mountLog(osfsVolume* vol);
+static result newFileLog(osfsVolume* vol, uint16_t fileID, const char* data, unsigned int size, uint8_t overwrite);
+static result deleteFileLog(osfsVolume* vol, uint16_t fileID);
+static result compactLog(osfsVolume* vol, uint16_t budget);
+static uint8_t logValid(uint16_t address, const fileHeader* header);
+static uint16_t logNext(const osfsVolume* vol, uint16_t address, const fileHeader* header);
+static uint16_t logFreeSpace(const osfsVolume* vol);
+static uint16_t logSpaceNeeded(const osfsVolume* vol, uint16_t size);
+static result logAppend(osfsVolume* vol, uint16_t fileID, uint8_t flags, uint16_t size, const char* data, uint16_t copyFrom, uint16_t* address);
+static result logMakeRoom(osfsVolume* vol, uint16_t size);
+static result logCleanStep(osfsVolume* vol, uint16_t* cost);
 
-   // Confirm that the EEPROM is managed by this version of OSFS
-   result r = checkLibVersion();
+result mount(osfsVolume* vol) {
+
+   vol->mounted = 0;
+
+   // Confirm that the EEPROM is managed by this version of OSFS, once
+   result r = checkLibVersionInternal(&vol->version);
 
    if (r != NO_ERROR)
        return r;
 
-   // It is! Now get the first file header
+   if (vol->version == OSFS_LOG_VER)
+       return mountLog(vol);
+
+   // Walk the file chain once, indexing every live file and finding its end
    fileHeader workingHeader;
    uint16_t workingAddress = startOfEEPROM + sizeof(FSInfo);
 
-   char paddedFilename[11];
-   padFilename(filename, paddedFilename);
+   memset(fileIndex, 0, sizeof(fileIndex));
+   fileIndexState = INDEX_BUILT;
+
+   vol->head = workingAddress;
+
+   // Everything before the end that live files do not take up can be
+   // reclaimed by compact()
+   uint16_t liveSpace = 0;
 
-   // Loop through checking the file header until
-   // 	a) we reach a NULL pointer,
-   // 	b) we find a deleted file that can be overwritten
-   // 	c) we get an OOL pointer somehow
    while (1) {
 
-       // Load the next header
-       result r = readNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
+       r = readNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
 
-       // Quit if we're out of bounds
-       if (r != NO_ERROR)
+       if (r != NO_ERROR) {
+           fileIndexState = INDEX_UNBUILT;
            return r;
+       }
 
-       // Is this the right file?
-       // Check the file ID
-       if (0 == strncmp(workingHeader.fileID, paddedFilename, 11)) {
-           // We found it!
-           // Is it marked as deleted?
-           if (isDeletedFile(workingHeader)) {
-               // File is deleted. :( continue onwards...
-           } else {
-               // Load the data into the receiving variables
-               *filePointer = workingAddress + sizeof(fileHeader);
-               *fileSize = workingHeader.fileSize;
+       if (workingHeader.nextFile == 0)
+           break;
 
-               return NO_ERROR;
-           }
+       if (!isDeletedFile(workingHeader)) {
+           indexInsert(workingHeader.fileID, workingAddress);
+           liveSpace += sizeof(fileHeader) + workingHeader.fileSize;
        }
 
-       // If there's no next file
-       if (workingHeader.nextFile == 0) {
+       workingAddress = workingHeader.nextFile;
+   }
 
-           return FILE_NOT_FOUND;
+   // An empty file at the end of the chain only marks where the next file
+   // goes, and gets written over by it
+   vol->tail = workingAddress;
+
+   if (workingHeader.fileSize != 0) {
+       vol->end = workingAddress + sizeof(fileHeader) + workingHeader.fileSize;
+
+       if (!isDeletedFile(workingHeader)) {
+           indexInsert(workingHeader.fileID, workingAddress);
+           liveSpace += sizeof(fileHeader) + workingHeader.fileSize;
        }
+   } else {
+       vol->end = workingAddress;
+   }
 
-       // Keep going
-       workingAddress = workingHeader.nextFile;
+   vol->deletedSpace = vol->end - vol->head - liveSpace;
+
+   vol->freeSpace = vol->end < endOfEEPROM ? endOfEEPROM - vol->end : 0;
+   vol->compactNext = 0;
+   vol->moveFrom = 0;
+   vol->mounted = 1;
+
+   return NO_ERROR;
+}
+
+result getFileInfo(const osfsVolume* vol, uint16_t fileID, uint16_t* filePointer, uint16_t* fileSize) {
+
+   if (!vol->mounted)
+       return NOT_MOUNTED;
+
+   fileHeader workingHeader;
+   uint16_t workingAddress;
+
+   result r = findFile(vol, fileID, &workingAddress, &workingHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   // Load the data into the receiving variables
+   *filePointer = workingAddress + (vol->version == OSFS_LOG_VER ? sizeof(logHeader) : sizeof(fileHeader));
+   *fileSize = workingHeader.fileSize;
+
+   return NO_ERROR;
+}
+
+result readFile(const osfsVolume* vol, uint16_t fileID, uint16_t offset, char* buf, uint16_t length, uint16_t* read) {
+
+   uint16_t filePointer, fileSize;
+   result r = getFileInfo(vol, fileID, &filePointer, &fileSize);
+
+   if (r != NO_ERROR)
+       return r;
+
+   // Nothing is left past the end of the file
+   if (offset >= fileSize) {
+       *read = 0;
+       return NO_ERROR;
    }
 
-   return UNDEFINED_ERROR;
+   if (length > fileSize - offset)
+       length = fileSize - offset;
+
+   *read = length;
+
+   return readNBytesChk(filePointer + offset, length, buf);
 }
 
-result newFile(const char* filename, const char* data, unsigned int size, uint8_t overwrite) {
+result newFile(osfsVolume* vol, uint16_t fileID, const char* data, unsigned int size, uint8_t overwrite) {
+
+   if (!vol->mounted)
+       return NOT_MOUNTED;
+
+   // The ID of empty files cannot be taken
+   if (fileID == OSFS_NO_ID)
+       return UNDEFINED_ERROR;
+
+   if (vol->version == OSFS_LOG_VER)
+       return newFileLog(vol, fileID, data, size, overwrite);
 
    // Header for new file
    fileHeader newHeader;
+   newHeader.fileID = fileID;
+
+   // Is there a file with the same ID already?
+   fileHeader workingHeader;
+   uint16_t workingAddress;
 
-   // Store padded filename in newHeader
-   padFilename(filename, newHeader.fileID);
+   result r = findFile(vol, fileID, &workingAddress, &workingHeader);
 
-   // Confirm that the EEPROM is managed by this version of OSFS
-   result r = checkLibVersion();
+   if (r == NO_ERROR) {
+       // Error if different sizes or overwrite == false
+       if (size != workingHeader.fileSize || !overwrite)
+           return FILE_ALREADY_EXISTS;
+
+       // else overwrite its contents in place, starting over if the file
+       // was being moved by compact()
+       if (workingAddress == vol->moveFrom)
+           vol->moveFrom = 0;
+
+       return writeNBytesChk(workingAddress + sizeof(fileHeader), size, data);
+   }
+
+   if (r != FILE_NOT_FOUND)
+       return r;
+
+   // New files go after the last one
+   unsigned int sizeRequired = sizeof(fileHeader) + size;
+   uint16_t writeAddress = vol->end;
+
+   // See if there's enough space in the EEPROM to fit our file in
+   if (sizeRequired > vol->freeSpace)
+       return INSUFFICIENT_SPACE;
+
+   // First, construct a header for this file:
+   newHeader.fileSize = size;
+   newHeader.nextFile = 0;
+   newHeader.flags = 0;
+
+   // Write the header and the data
+   r = writeNBytesChk(writeAddress, sizeof(fileHeader), &newHeader);
+
+   if (r == NO_ERROR)
+       r = writeNBytesChk(writeAddress + sizeof(fileHeader), size, data);
 
    if (r != NO_ERROR)
        return r;
 
-   // It is! Now get the first file header
-   int sizeRequired = sizeof(fileHeader) + size;
+   // Now, alter the last file's header to point to this new file, unless
+   // this one took the place of an empty one
+   if (writeAddress != vol->tail) {
+       r = readNBytesChk(vol->tail, sizeof(fileHeader), &workingHeader);
 
-   fileHeader workingHeader;
-   uint16_t workingAddress = startOfEEPROM + sizeof(FSInfo);
-   uint16_t writeAddress;
+       if (r != NO_ERROR)
+           return r;
 
-   // Loop through checking the file header until
-   // 	a) we reach a NULL pointer,
-   // 	b) we find a deleted file that can be overwritten
-   // 	c) we find a file with the same name as this one (overwrite it if same size and overwrite == true)
-   // 	d) we get an OOL pointer somehow
-   while (1) {
+       workingHeader.nextFile = writeAddress;
 
-       // Load the next header
-       result r = readNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
+       r = writeNBytesChk(vol->tail, sizeof(fileHeader), &workingHeader);
 
-       // Quit if we're out of bounds
        if (r != NO_ERROR)
            return r;
+   }
 
-       // Quit if it has the same name and isn't deleted
-       if (!isDeletedFile(workingHeader) && 0 == strncmp(workingHeader.fileID, newHeader.fileID, 11)) {
-           // Error if different sizes or overwrite == false
-           if (size != workingHeader.fileSize || !overwrite)
-               return FILE_ALREADY_EXISTS;
+   // An empty file written over at the end is no longer there
+   indexRemove(writeAddress);
+   indexInsert(fileID, writeAddress);
 
-           // else overwrite it
-           writeAddress = workingAddress;
-           break;
-       }
+   vol->tail = writeAddress;
+   vol->end = size != 0 ? writeAddress + sizeRequired : writeAddress;
+   vol->freeSpace = endOfEEPROM - vol->end;
 
-       // If there's no next file, calculate the start of the spare space and break the loop
-       if (workingHeader.nextFile == 0) {
+   return NO_ERROR;
+}
 
-           if (workingHeader.fileSize != 0)
-               writeAddress = workingAddress + sizeof(workingHeader) + workingHeader.fileSize;
-           else
-               writeAddress = workingAddress;
+result newFiles(osfsVolume* vol, newFileEntry* files, uint8_t count) {
 
-           break;
+   if (!vol->mounted)
+       return NOT_MOUNTED;
+
+   // Log volumes take the files one at a time
+   if (vol->version == OSFS_LOG_VER) {
+       result batch = NO_ERROR;
+
+       for (uint8_t i = 0; i < count; i++) {
+           files[i].status = newFile(vol, files[i].fileID, files[i].data, files[i].size, 0);
+
+           if (files[i].status != NO_ERROR && files[i].status != FILE_ALREADY_EXISTS)
+               batch = files[i].status;
        }
 
-       // If this is a deleted file, see if we can fit our file here
-       if (isDeletedFile(workingHeader)) {
-           // It is. Is the space large enough for us?
-           int deletedSpace = workingHeader.nextFile - workingAddress;
-           if (deletedSpace >= sizeRequired)
-               writeAddress = workingAddress;
+       return batch;
+   }
+
+   // First pass: decide which files go in and where, without writing anything
+   fileHeader workingHeader;
+   uint16_t workingAddress;
+   uint16_t writeAddress = vol->end;
+   uint8_t toWrite = 0;
+
+   for (uint8_t i = 0; i < count; i++) {
+       result r = files[i].fileID == OSFS_NO_ID
+                  ? UNDEFINED_ERROR
+                  : findFile(vol, files[i].fileID, &workingAddress, &workingHeader);
+
+       if (r == FILE_NOT_FOUND) {
+           // IDs can also clash within the batch
+           r = NO_ERROR;
+           for (uint8_t j = 0; j < i && r == NO_ERROR; j++)
+               if (files[j].status == NO_ERROR && files[j].fileID == files[i].fileID)
+                   r = FILE_ALREADY_EXISTS;
+       } else if (r == NO_ERROR) {
+           r = FILE_ALREADY_EXISTS;
        }
 
-       // Nope, next
-       workingAddress = workingHeader.nextFile;
+       files[i].status = r;
+
+       if (r == NO_ERROR) {
+           writeAddress += sizeof(fileHeader) + files[i].size;
+           toWrite++;
+       }
    }
 
-   // See if there's enough space in the EEPROM to fit our file in
-   if (writeAddress + sizeRequired - 1 > endOfEEPROM)
+   if (toWrite == 0)
+       return NO_ERROR;
+
+   // All or nothing: check that every file fits before writing any of them
+   if (writeAddress - vol->end > vol->freeSpace) {
+       for (uint8_t i = 0; i < count; i++)
+           if (files[i].status == NO_ERROR)
+               files[i].status = INSUFFICIENT_SPACE;
+
        return INSUFFICIENT_SPACE;
+   }
 
-   // We have a pointer to an address that has sufficient space to store our
-   // data, in writeAddress.
-   //
-   // We have a pointer to the previous header in workingAddress
-   //
-   // We have a copy of the previous header in workingHeader
-   //
-   // First, constuct a header for this file:
+   // Second pass: write the files one after the other, each header pointing
+   // to the next. The header of the first file is written last, and then the
+   // old tail is linked to it, so that the chain only takes in the batch once
+   // it has all been written.
+   uint16_t firstAddress = vol->end;
+   uint16_t lastAddress = firstAddress;
+   fileHeader firstHeader;
+   uint8_t written = 0;
 
-   newHeader.fileSize = size;
-   if (workingHeader.nextFile == 0)
-       newHeader.nextFile = 0;
-   else
-       newHeader.nextFile = workingHeader.nextFile;
-   newHeader.flags = 0;
+   writeAddress = firstAddress;
+
+   for (uint8_t i = 0; i < count; i++) {
+       if (files[i].status != NO_ERROR)
+           continue;
+
+       fileHeader newHeader;
+       newHeader.fileID = files[i].fileID;
+       newHeader.fileSize = files[i].size;
+       newHeader.flags = 0;
+
+       uint16_t nextAddress = writeAddress + sizeof(fileHeader) + files[i].size;
+       newHeader.nextFile = ++written < toWrite ? nextAddress : 0;
+
+       result r = writeNBytesChk(writeAddress + sizeof(fileHeader), files[i].size, files[i].data);
+
+       if (r == NO_ERROR && writeAddress != firstAddress)
+           r = writeNBytesChk(writeAddress, sizeof(fileHeader), &newHeader);
+
+       if (r != NO_ERROR) {
+           files[i].status = r;
+           return r;
+       }
+
+       if (writeAddress == firstAddress)
+           firstHeader = newHeader;
+
+       lastAddress = writeAddress;
+       writeAddress = nextAddress;
+   }
+
+   result r = writeNBytesChk(firstAddress, sizeof(fileHeader), &firstHeader);
+
+   if (r == NO_ERROR && firstAddress != vol->tail) {
+       r = readNBytesChk(vol->tail, sizeof(fileHeader), &workingHeader);
+
+       if (r == NO_ERROR) {
+           workingHeader.nextFile = firstAddress;
+           r = writeNBytesChk(vol->tail, sizeof(fileHeader), &workingHeader);
+       }
+   }
+
+   if (r != NO_ERROR)
+       return r;
+
+   // The batch is in: index it and move the end of the volume past it
+   indexRemove(firstAddress);
+   writeAddress = firstAddress;
+
+   for (uint8_t i = 0; i < count; i++) {
+       if (files[i].status != NO_ERROR)
+           continue;
+
+       indexInsert(files[i].fileID, writeAddress);
+       writeAddress += sizeof(fileHeader) + files[i].size;
+   }
 
-   // Now, alter the previous file's header to point to this new file
-   workingHeader.nextFile = writeAddress;
+   vol->tail = lastAddress;
+   vol->end = writeAddress;
+   vol->freeSpace = endOfEEPROM - vol->end;
 
-   // Write the headers and the data
-   writeNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
-   writeNBytesChk(writeAddress, sizeof(fileHeader), &newHeader);
-   return writeNBytesChk(writeAddress + sizeof(fileHeader), size, data);
+   return NO_ERROR;
 }
 
-result deleteFile(const char * filename) {
+result deleteFile(osfsVolume* vol, uint16_t fileID) {
+
+   if (!vol->mounted)
+       return NOT_MOUNTED;
+
+   if (vol->version == OSFS_LOG_VER)
+       return deleteFileLog(vol, fileID);
+
+   fileHeader workingHeader;
+   uint16_t workingAddress;
 
-   // Confirm that the EEPROM is managed by this version of OSFS
-   result r = checkLibVersion();
+   result r = findFile(vol, fileID, &workingAddress, &workingHeader);
 
    if (r != NO_ERROR)
        return r;
 
-   // Store padded filename in filenamePadded
-   char filenamePadded[11];
-   padFilename(filename, filenamePadded);
+   // Mark it as deleted
+   workingHeader.flags = workingHeader.flags | 1<<DELBIT;
+   r = writeNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   indexRemove(workingAddress);
+
+   // There is no point in finishing moving it
+   if (workingAddress == vol->moveFrom)
+       vol->moveFrom = 0;
+
+   vol->deletedSpace += sizeof(fileHeader) + workingHeader.fileSize;
+
+   return NO_ERROR;
+}
+
+result compact(osfsVolume* vol, uint16_t budget) {
+
+   if (!vol->mounted)
+       return NOT_MOUNTED;
+
+   if (vol->version == OSFS_LOG_VER)
+       return compactLog(vol, budget);
+
+   // Only start a pass once there is something to reclaim
+   if (vol->compactNext == 0) {
+       if (vol->deletedSpace == 0)
+           return NO_ERROR;
+
+       vol->compactNext = vol->head;
+       vol->compactPrev = 0;
+       vol->compactEnd = vol->head;
+       vol->moveFrom = 0;
+   }
 
-   // Get the first header
    fileHeader workingHeader;
-   uint16_t workingAddress = startOfEEPROM + sizeof(FSInfo);
+   result r;
 
-   // Loop through checking the file header until
-   // 	a) we reach a NULL pointer,
-   // 	b) we find our file and it's not deleted
-   // 	c) we get an OOL pointer somehow
-   while (1) {
+   while (budget > 0) {
 
-       // Load the next header
-       result r = readNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
+       uint16_t workingAddress = vol->compactNext;
+
+       r = readNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
 
-       // Quit if we're out of bounds
        if (r != NO_ERROR)
            return r;
 
-       // Delete the file if it has the same name and isn't already deleted
-       if (!isDeletedFile(workingHeader) && 0 == strncmp(workingHeader.fileID, filenamePadded, 11)) {
+       if (vol->moveFrom == 0) {
+
+           // Deleted files are dropped, merging with the gap before them
+           if (isDeletedFile(workingHeader)) {
+               uint16_t dropped = sizeof(fileHeader) + workingHeader.fileSize;
+               vol->deletedSpace = dropped < vol->deletedSpace ? vol->deletedSpace - dropped : 0;
+
+               if (workingHeader.nextFile == 0)
+                   return finishCompaction(vol);
+
+               vol->compactNext = workingHeader.nextFile;
+               continue;
+           }
 
-           workingHeader.flags = workingHeader.flags | 1<<DELBIT;
-           r = writeNBytesChk(workingAddress, sizeof(fileHeader), &workingHeader);
+           // An empty file at the end only marks where the next file goes
+           if (workingHeader.nextFile == 0 && workingHeader.fileSize == 0)
+               return finishCompaction(vol);
+
+           // Files with no gap before them stay where they are
+           if (workingAddress == vol->compactEnd) {
+               vol->compactPrev = workingAddress;
+               vol->compactEnd = workingAddress + sizeof(fileHeader) + workingHeader.fileSize;
+
+               if (workingHeader.nextFile == 0)
+                   return finishCompaction(vol);
+
+               vol->compactNext = workingHeader.nextFile;
+               continue;
+           }
+
+           // Otherwise unlink the gap, so that the chain stays whole while
+           // the file is moved into it. At the head of the chain the
+           // header stays in place, as a deleted file pointing past the gap.
+           if (vol->compactPrev != 0) {
+               r = setNextFile(vol->compactPrev, workingAddress);
+           } else {
+               fileHeader gapHeader;
+               gapHeader.fileID = OSFS_NO_ID;
+               gapHeader.fileSize = 0;
+               gapHeader.nextFile = workingAddress;
+               gapHeader.flags = 1<<DELBIT;
+               r = writeNBytesChk(vol->head, sizeof(fileHeader), &gapHeader);
+           }
 
            if (r != NO_ERROR)
                return r;
 
-           return NO_ERROR;
+           vol->moveFrom = workingAddress;
+           vol->moveDone = 0;
        }
 
-       // Quit if we get a NULL pointer
-       if (workingHeader.nextFile == 0)
-           return FILE_NOT_FOUND;
+       // Move the contents first, a chunk at a time, and the header last
+       uint16_t moveTo = vol->compactEnd;
+       uint16_t size = workingHeader.fileSize;
+       uint8_t overlaps = moveTo + sizeof(fileHeader) + size > vol->moveFrom;
 
-       // Next file
-       workingAddress = workingHeader.nextFile;
+       while (vol->moveDone < size && (budget > 0 || overlaps)) {
+           byte chunk[16];
+           uint16_t length = size - vol->moveDone;
+
+           if (length > sizeof(chunk))
+               length = sizeof(chunk);
+           if (!overlaps && length > budget)
+               length = budget;
+
+           r = readNBytesChk(vol->moveFrom + sizeof(fileHeader) + vol->moveDone, length, chunk);
+
+           if (r == NO_ERROR)
+               r = writeNBytesChk(moveTo + sizeof(fileHeader) + vol->moveDone, length, chunk);
+
+           if (r != NO_ERROR)
+               return r;
+
+           vol->moveDone += length;
+           budget = length < budget ? budget - length : 0;
+       }
+
+       if (vol->moveDone < size)
+           return NO_ERROR;
+
+       r = writeNBytesChk(moveTo, sizeof(fileHeader), &workingHeader);
+
+       if (r == NO_ERROR && vol->compactPrev != 0)
+           r = setNextFile(vol->compactPrev, moveTo);
+
+       if (r != NO_ERROR)
+           return r;
+
+       budget = sizeof(fileHeader) < budget ? budget - sizeof(fileHeader) : 0;
+
+       indexRemove(vol->moveFrom);
+       indexInsert(workingHeader.fileID, moveTo);
+
+       vol->moveFrom = 0;
+       vol->compactPrev = moveTo;
+       vol->compactEnd = moveTo + sizeof(fileHeader) + size;
+
+       if (workingHeader.nextFile == 0) {
+           vol->tail = moveTo;
+           return finishCompaction(vol);
+       }
+
+       vol->compactNext = workingHeader.nextFile;
    }
 
-   // We will never get here
-   return UNDEFINED_ERROR;
+   return NO_ERROR;
 }
 
-result checkLibVersionInternal(uint16_t ver) {
+result checkLibVersionInternal(uint16_t* ver) {
 
    // Load the identifying info
    FSInfo theROMInfo;
 
-   readNBytesChk(startOfEEPROM, sizeof(FSInfo), &theROMInfo);
+   result r = readNBytesChk(startOfEEPROM, sizeof(FSInfo), &theROMInfo);
+
+   if (r != NO_ERROR)
+       return r;
 
    // Check for the ID string
    if (0 != strncmp(theROMInfo.idStr, OSFS_ID_STR, 4)) {
-       ver = 0;
+       *ver = 0;
        return UNFORMATTED;
    }
 
    // Check the version
-   ver = theROMInfo.version;
+   *ver = theROMInfo.version;
 
-   if (ver != OSFS_VER) {
+   if (*ver != OSFS_VER && *ver != OSFS_LOG_VER) {
        return WRONG_VERSION;
    }
 
    return NO_ERROR;
 }
 
-result format() {
+result format(osfsVolume* vol) {
 
    // Create identifying info for this version
    FSInfo thisInfo;
 
-   strncpy(thisInfo.idStr, OSFS_ID_STR, 4);
+   memcpy(thisInfo.idStr, OSFS_ID_STR, 4);
    thisInfo.version = OSFS_VER;
 
    // Write this to the FS
@@ -268,48 +609,635 @@ result format() {
 
    // Create a dummy file header, marking where the next file will go
    fileHeader dummyHeader;
-   padFilename("", dummyHeader.fileID);
+   dummyHeader.fileID = OSFS_NO_ID;
    dummyHeader.fileSize = 0;
    dummyHeader.nextFile = 0;
    dummyHeader.flags = 0;
 
    // Store this after the FS identifying info
-   return writeNBytesChk(startOfEEPROM + sizeof(FSInfo), sizeof(fileHeader), &dummyHeader);
+   r = writeNBytesChk(startOfEEPROM + sizeof(FSInfo), sizeof(fileHeader), &dummyHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   return mount(vol);
+}
+
+result formatLog(osfsVolume* vol) {
+
+   // Records of a log already here must never pass for part of the new
+   // one, so its sequence numbers are carried on from
+   uint16_t seq = 0;
+   uint16_t ver;
+
+   if (checkLibVersionInternal(&ver) == NO_ERROR && ver == OSFS_LOG_VER && mountLog(vol) == NO_ERROR)
+       seq = vol->nextSeq;
+
+   vol->mounted = 0;
+
+   FSInfo thisInfo;
+
+   memcpy(thisInfo.idStr, OSFS_ID_STR, 4);
+   thisInfo.version = OSFS_LOG_VER;
+
+   result r = writeNBytesChk(startOfEEPROM, sizeof(FSInfo), &thisInfo);
+
+   if (r != NO_ERROR)
+       return r;
+
+   // The log starts with a deleted record, so that there always is a newest
+   // record to carry on from
+   logHeader firstHeader;
+   firstHeader.file.fileID = OSFS_NO_ID;
+   firstHeader.file.fileSize = 0;
+   firstHeader.file.nextFile = seq;
+   firstHeader.file.flags = 1<<DELBIT;
+   firstHeader.tail = startOfEEPROM + sizeof(FSInfo);
+
+   r = writeNBytesChk(firstHeader.tail, sizeof(logHeader), &firstHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   return mount(vol);
+}
+
+void useBackend(const osfsBackend* newBackend) {
+   backend = newBackend;
+   startOfEEPROM = newBackend->start;
+   endOfEEPROM = newBackend->end;
+
+   // Nothing indexed so far is on the new backend
+   fileIndexState = INDEX_UNBUILT;
 }
 
 result writeNBytesChk(uint16_t address, unsigned int num, const void* input) {
+   if (backend == NULL) return UNDEFINED_ERROR;
+   if (backend->write == NULL) return READ_ONLY;
    if (address < startOfEEPROM || address > endOfEEPROM) return UNCAUGHT_OOR;
-   if (address + num < startOfEEPROM || address + num > endOfEEPROM) return UNCAUGHT_OOR;
+   // In 32 bits, since a volume may reach the end of the 16-bit range
+   if ((uint32_t) address + num > endOfEEPROM) return UNCAUGHT_OOR;
 
-   writeNBytes(address, num, input);
-
-   return NO_ERROR;
+   return backend->write(address, num, input);
 }
 
 result readNBytesChk(uint16_t address, unsigned int num, void* output) {
 
+   if (backend == NULL) return UNDEFINED_ERROR;
    if (address < startOfEEPROM || address > endOfEEPROM) return UNCAUGHT_OOR;
-   if (address + num < startOfEEPROM || address + num > endOfEEPROM) return UNCAUGHT_OOR;
+   if ((uint32_t) address + num > endOfEEPROM) return UNCAUGHT_OOR;
+
+   return backend->read(address, num, output);
+}
+
+
+// Spread the IDs, which differ mostly in their low bits, over the slots
+static uint8_t indexSlot(uint16_t fileID) {
+   return ((uint16_t) (fileID * 40503u) >> 8) % OSFS_INDEX_SIZE;
+}
+
+static void indexInsert(uint16_t fileID, uint16_t headerAddress) {
+   if (fileIndexState != INDEX_BUILT)
+       return;
+
+   uint8_t slot = indexSlot(fileID);
+
+   for (int i = 0; i < OSFS_INDEX_SIZE; i++) {
+       indexEntry* entry = &fileIndex[slot];
+
+       if (entry->address == INDEX_EMPTY || entry->address == INDEX_REMOVED) {
+           entry->fileID = fileID;
+           entry->address = headerAddress;
+           return;
+       }
+
+       slot = (slot + 1) % OSFS_INDEX_SIZE;
+   }
+
+   // Out of slots: lookups go back to walking the chain
+   fileIndexState = INDEX_OVERFLOWED;
+}
+
+static uint8_t indexHasRoom() {
+   for (int i = 0; i < OSFS_INDEX_SIZE; i++)
+       if (fileIndex[i].address == INDEX_EMPTY || fileIndex[i].address == INDEX_REMOVED)
+           return 1;
+
+   return 0;
+}
+
+static void indexRemove(uint16_t headerAddress) {
+   for (int i = 0; i < OSFS_INDEX_SIZE; i++)
+       if (fileIndex[i].address == headerAddress)
+           fileIndex[i].address = INDEX_REMOVED;
+}
+
+// Returns UNDEFINED_ERROR if the index cannot answer, and the chain has to be
+// walked instead
+static result indexLookup(uint16_t fileID, uint16_t* headerAddress, fileHeader* header) {
+   if (fileIndexState != INDEX_BUILT)
+       return UNDEFINED_ERROR;
+
+   uint8_t slot = indexSlot(fileID);
+
+   for (int i = 0; i < OSFS_INDEX_SIZE; i++) {
+       indexEntry* entry = &fileIndex[slot];
+
+       if (entry->address == INDEX_EMPTY)
+           return FILE_NOT_FOUND;
+
+       // Only the header of the file itself is read
+       if (entry->address != INDEX_REMOVED && entry->fileID == fileID) {
+           *headerAddress = entry->address;
+           return readNBytesChk(entry->address, sizeof(fileHeader), header);
+       }
+
+       slot = (slot + 1) % OSFS_INDEX_SIZE;
+   }
+
+   return FILE_NOT_FOUND;
+}
+
+// Find the header of a live file, through the index if it covers every file
+static result findFile(const osfsVolume* vol, uint16_t fileID, uint16_t* headerAddress, fileHeader* header) {
+
+   if (fileID == OSFS_NO_ID)
+       return FILE_NOT_FOUND;
+
+   result r = indexLookup(fileID, headerAddress, header);
+
+   if (r != UNDEFINED_ERROR)
+       return r;
+
+   uint16_t workingAddress = vol->head;
+
+   // Loop through checking the file header until
+   // 	a) we reach a NULL pointer,
+   // 	b) we find our file and it's not deleted
+   // 	c) we get an OOL pointer somehow
+   while (1) {
+
+       // Load the next header
+       r = readNBytesChk(workingAddress, sizeof(fileHeader), header);
+
+       // Quit if we're out of bounds
+       if (r != NO_ERROR)
+           return r;
+
+       if (!isDeletedFile(*header) && header->fileID == fileID) {
+           *headerAddress = workingAddress;
+           return NO_ERROR;
+       }
+
+       // Quit if we get a NULL pointer
+       if (header->nextFile == 0)
+           return FILE_NOT_FOUND;
+
+       // Next file
+       workingAddress = header->nextFile;
+   }
+}
+
+static result setNextFile(uint16_t headerAddress, uint16_t nextFile) {
+   fileHeader workingHeader;
+
+   result r = readNBytesChk(headerAddress, sizeof(fileHeader), &workingHeader);
+
+   if (r != NO_ERROR || workingHeader.nextFile == nextFile)
+       return r;
+
+   workingHeader.nextFile = nextFile;
+
+   return writeNBytesChk(headerAddress, sizeof(fileHeader), &workingHeader);
+}
+
+// End the chain at the last live file, leaving all the space after it free
+static result finishCompaction(osfsVolume* vol) {
+   result r;
+
+   if (vol->compactPrev != 0) {
+       r = setNextFile(vol->compactPrev, 0);
+       vol->tail = vol->compactPrev;
+   } else {
+       // No files are left: back to the empty file format() writes
+       fileHeader dummyHeader;
+       dummyHeader.fileID = OSFS_NO_ID;
+       dummyHeader.fileSize = 0;
+       dummyHeader.nextFile = 0;
+       dummyHeader.flags = 0;
+       r = writeNBytesChk(vol->head, sizeof(fileHeader), &dummyHeader);
+       vol->tail = vol->head;
+   }
+
+   if (r != NO_ERROR)
+       return r;
+
+   vol->end = vol->compactEnd;
+   vol->freeSpace = endOfEEPROM - vol->end;
+   vol->compactNext = 0;
+   vol->moveFrom = 0;
+
+   return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+// Log volumes
+//
+// Records go from vol->tail, the oldest, to vol->end, where the next one is
+// written, going back to vol->head past the end of the EEPROM. A record that
+// would not fit before the end is written at the head instead, after a wrap
+// record, and the few bytes left after a record with no room for a header
+// are skipped in the same way.
+
+// Free space kept for logCleanStep() to copy a record forward, wrapping
+// around included
+#define LOG_RESERVE (3 * (sizeof(logHeader) + OSFS_LOG_MAX_FILE))
+
+static result mountLog(osfsVolume* vol) {
+
+   logHeader workingHeader;
+   logHeader nextHeader;
+   uint16_t workingAddress = startOfEEPROM + sizeof(FSInfo);
+
+   vol->head = workingAddress;
+
+   result r = readNBytesChk(workingAddress, sizeof(logHeader), &workingHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   if (!logValid(workingAddress, &workingHeader.file))
+       return UNFORMATTED;
+
+   // Everything from the head up to the newest record was written since the
+   // log last went past the end, one record after the other. What follows
+   // it is older, and its sequence numbers do not carry on.
+   while (1) {
+       uint16_t nextAddress = logNext(vol, workingAddress, &workingHeader.file);
+
+       if (nextAddress == vol->head)
+           break;
+
+       r = readNBytesChk(nextAddress, sizeof(logHeader), &nextHeader);
+
+       if (r != NO_ERROR)
+           return r;
+
+       if (nextHeader.file.nextFile != (uint16_t) (workingHeader.file.nextFile + 1)
+           || !logValid(nextAddress, &nextHeader.file))
+           break;
+
+       workingAddress = nextAddress;
+       workingHeader = nextHeader;
+   }
+
+   vol->end = logNext(vol, workingAddress, &workingHeader.file);
+   vol->tail = workingHeader.tail;
+   vol->nextSeq = workingHeader.file.nextFile + 1;
+
+   if (vol->tail < vol->head || vol->tail > endOfEEPROM - sizeof(logHeader))
+       return UNFORMATTED;
+
+   // Replay the log from its oldest record, so that the index ends up with
+   // the newest record of each file
+   memset(fileIndex, 0, sizeof(fileIndex));
+   fileIndexState = INDEX_BUILT;
+
+   vol->deletedSpace = 0;
+   workingAddress = vol->tail;
+
+   for (uint16_t replayed = 0; workingAddress != vol->end; ) {
+
+       r = readNBytesChk(workingAddress, sizeof(logHeader), &workingHeader);
+
+       if (r == NO_ERROR && !logValid(workingAddress, &workingHeader.file))
+           r = UNFORMATTED;
+
+       uint16_t nextAddress = logNext(vol, workingAddress, &workingHeader.file);
+       uint16_t length = nextAddress == vol->head ? endOfEEPROM - workingAddress : nextAddress - workingAddress;
+
+       // A log that never gets back to its newest record is not one
+       replayed += length;
+
+       if (r == NO_ERROR && replayed > endOfEEPROM - vol->head)
+           r = UNFORMATTED;
+
+       if (r != NO_ERROR) {
+           fileIndexState = INDEX_UNBUILT;
+           return r;
+       }
+
+       if (!(workingHeader.file.flags & 1<<WRAPBIT)) {
+           uint16_t previousAddress;
+           fileHeader previousHeader;
+
+           if (indexLookup(workingHeader.file.fileID, &previousAddress, &previousHeader) == NO_ERROR) {
+               indexRemove(previousAddress);
+               vol->deletedSpace += sizeof(logHeader) + previousHeader.fileSize;
+           }
+
+           if (isDeletedFile(workingHeader.file))
+               vol->deletedSpace += sizeof(logHeader) + workingHeader.file.fileSize;
+           else
+               indexInsert(workingHeader.file.fileID, workingAddress);
+       }
+
+       workingAddress = nextAddress;
+   }
+
+   if (fileIndexState != INDEX_BUILT) {
+       fileIndexState = INDEX_UNBUILT;
+       return INSUFFICIENT_SPACE;
+   }
+
+   vol->freeSpace = logFreeSpace(vol);
+   vol->compactNext = 0;
+   vol->moveFrom = 0;
+   vol->mounted = 1;
+
+   return NO_ERROR;
+}
+
+static result newFileLog(osfsVolume* vol, uint16_t fileID, const char* data, unsigned int size, uint8_t overwrite) {
+
+   // Make room first, since that can move the file being overwritten
+   result r = logMakeRoom(vol, size);
+
+   if (r != NO_ERROR)
+       return r;
+
+   fileHeader workingHeader;
+   uint16_t workingAddress;
+
+   r = findFile(vol, fileID, &workingAddress, &workingHeader);
 
-   readNBytes(address, num, output);
+   if (r == NO_ERROR && !overwrite)
+       return FILE_ALREADY_EXISTS;
+
+   if (r == FILE_NOT_FOUND && !indexHasRoom())
+       return INSUFFICIENT_SPACE;
+
+   if (r != NO_ERROR && r != FILE_NOT_FOUND)
+       return r;
+
+   uint8_t existed = r == NO_ERROR;
+   uint16_t newAddress;
+
+   r = logAppend(vol, fileID, 0, size, data, 0, &newAddress);
+
+   if (r != NO_ERROR)
+       return r;
+
+   // The newer record supersedes the old one
+   if (existed) {
+       indexRemove(workingAddress);
+       vol->deletedSpace += sizeof(logHeader) + workingHeader.fileSize;
+   }
+
+   indexInsert(fileID, newAddress);
+
+   return NO_ERROR;
+}
+
+static result deleteFileLog(osfsVolume* vol, uint16_t fileID) {
+
+   result r = logMakeRoom(vol, 0);
+
+   if (r != NO_ERROR)
+       return r;
+
+   fileHeader workingHeader;
+   uint16_t workingAddress;
+
+   r = findFile(vol, fileID, &workingAddress, &workingHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   uint16_t newAddress;
+
+   r = logAppend(vol, fileID, 1<<DELBIT, 0, NULL, 0, &newAddress);
+
+   if (r != NO_ERROR)
+       return r;
+
+   indexRemove(workingAddress);
+
+   // Both the file and the record deleting it can go once reclaimed
+   vol->deletedSpace += 2 * sizeof(logHeader) + workingHeader.fileSize;
+
+   return NO_ERROR;
+}
+
+static result compactLog(osfsVolume* vol, uint16_t budget) {
+
+   while (budget > 0 && vol->deletedSpace > 0 && vol->freeSpace < OSFS_LOG_CLEAN_BELOW) {
+       uint16_t cost;
+       result r = logCleanStep(vol, &cost);
+
+       if (r != NO_ERROR)
+           return r;
+
+       budget = cost < budget ? budget - cost : 0;
+   }
 
    return NO_ERROR;
 }
 
+// Whether a record could be at <address>, going by its header
+static uint8_t logValid(uint16_t address, const fileHeader* header) {
+   return (header->flags & ~(1<<DELBIT | 1<<WRAPBIT)) == 0
+       && header->fileSize <= endOfEEPROM - address - sizeof(logHeader);
+}
+
+// Address of the record after the one at <address>
+static uint16_t logNext(const osfsVolume* vol, uint16_t address, const fileHeader* header) {
+   if (header->flags & 1<<WRAPBIT)
+       return vol->head;
 
-void padFilename(const char * filenameIn, char * filenameOut) {
-   // Pad filename to 11 chars
-   uint8_t ended = 0;
-   for (int i = 0; i<11; i++) {
+   uint16_t next = address + sizeof(logHeader) + header->fileSize;
 
-       char inChar = *(filenameIn+i);
+   if ((uint16_t) (endOfEEPROM - next) < sizeof(logHeader))
+       return vol->head;
+
+   return next;
+}
 
-       if (inChar == '\0' || ended)
-       {
-           *(filenameOut+i) = ' ';
-           ended = 1;
+static uint16_t logFreeSpace(const osfsVolume* vol) {
+   if (vol->end < vol->tail)
+       return vol->tail - vol->end;
+
+   return endOfEEPROM - vol->end + vol->tail - vol->head;
+}
+
+// Bytes a record of <size> would take up at the end of the log, counting
+// those skipped before and after it
+static uint16_t logSpaceNeeded(const osfsVolume* vol, uint16_t size) {
+   uint16_t length = sizeof(logHeader) + size;
+   uint16_t address = vol->end;
+   uint16_t needed = length;
+
+   if (endOfEEPROM - address < length) {
+       needed += endOfEEPROM - address;
+       address = vol->head;
+   }
+
+   if ((uint16_t) (endOfEEPROM - (address + length)) < sizeof(logHeader))
+       needed += endOfEEPROM - (address + length);
+
+   return needed;
+}
+
+// Write a record at the end of the log. Its contents come from <data>, or
+// from the EEPROM at <copyFrom> if <data> is NULL. The caller checks that it
+// fits and updates the index.
+static result logAppend(osfsVolume* vol, uint16_t fileID, uint8_t flags, uint16_t size, const char* data, uint16_t copyFrom, uint16_t* address) {
+
+   uint16_t length = sizeof(logHeader) + size;
+   result r;
+
+   if (endOfEEPROM - vol->end < length) {
+       logHeader wrapHeader;
+       wrapHeader.file.fileID = OSFS_NO_ID;
+       wrapHeader.file.fileSize = 0;
+       wrapHeader.file.nextFile = vol->nextSeq;
+       wrapHeader.file.flags = 1<<WRAPBIT;
+       wrapHeader.tail = vol->tail;
+
+       r = writeNBytesChk(vol->end, sizeof(logHeader), &wrapHeader);
+
+       if (r != NO_ERROR)
+           return r;
+
+       vol->nextSeq++;
+       vol->end = vol->head;
+   }
+
+   *address = vol->end;
+
+   // The contents go in before the header that makes them part of the log
+   if (data != NULL) {
+       r = writeNBytesChk(*address + sizeof(logHeader), size, data);
+   } else {
+       r = NO_ERROR;
+
+       for (uint16_t done = 0; done < size && r == NO_ERROR; ) {
+           byte chunk[16];
+           uint16_t chunkLength = size - done;
+
+           if (chunkLength > sizeof(chunk))
+               chunkLength = sizeof(chunk);
+
+
+           r = readNBytesChk(copyFrom + done, chunkLength, chunk);
+
+           if (r == NO_ERROR)
+               r = writeNBytesChk(*address + sizeof(logHeader) + done, chunkLength, chunk);
+
+           done += chunkLength;
+       }
+   }
+
+   if (r != NO_ERROR)
+       return r;
+
+   logHeader newHeader;
+   newHeader.file.fileID = fileID;
+   newHeader.file.fileSize = size;
+   newHeader.file.nextFile = vol->nextSeq;
+   newHeader.file.flags = flags;
+   newHeader.tail = vol->tail;
+
+   r = writeNBytesChk(*address, sizeof(logHeader), &newHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   vol->nextSeq++;
+   vol->end = logNext(vol, *address, &newHeader.file);
+   vol->freeSpace = logFreeSpace(vol);
+
+   return NO_ERROR;
+}
+
+// Reclaim records until a record of <size> fits, keeping LOG_RESERVE free
+static result logMakeRoom(osfsVolume* vol, uint16_t size) {
+
+   if (size > OSFS_LOG_MAX_FILE)
+       return INSUFFICIENT_SPACE;
+
+   while (logSpaceNeeded(vol, size) + LOG_RESERVE >= vol->freeSpace) {
+
+       // Copying current records forward does not make room by itself
+       if (vol->deletedSpace == 0)
+           return INSUFFICIENT_SPACE;
+
+       uint16_t cost;
+       result r = logCleanStep(vol, &cost);
+
+       if (r != NO_ERROR)
+           return r;
+   }
+
+   return NO_ERROR;
+}
+
+// Reclaim the oldest record, copying it to the end of the log first if it is
+// still current. <cost> is set to the bytes read and written.
+static result logCleanStep(osfsVolume* vol, uint16_t* cost) {
+
+   uint16_t workingAddress = vol->tail;
+   *cost = 0;
+
+   // Nothing is left to reclaim in an empty log
+   if (workingAddress == vol->end) {
+       vol->deletedSpace = 0;
+       return NO_ERROR;
+   }
+
+   logHeader workingHeader;
+   result r = readNBytesChk(workingAddress, sizeof(logHeader), &workingHeader);
+
+   if (r != NO_ERROR)
+       return r;
+
+   *cost = sizeof(logHeader);
+
+   if (!(workingHeader.file.flags & 1<<WRAPBIT)) {
+       fileHeader currentHeader;
+       uint16_t currentAddress;
+
+       r = findFile(vol, workingHeader.file.fileID, &currentAddress, &currentHeader);
+
+       if (r != NO_ERROR && r != FILE_NOT_FOUND)
+           return r;
+
+       uint16_t size = workingHeader.file.fileSize;
+
+       if (r == NO_ERROR && currentAddress == workingAddress) {
+           // Still current: the copy supersedes it, and it is reclaimed
+           // straight away
+           if (logSpaceNeeded(vol, size) >= vol->freeSpace)
+               return INSUFFICIENT_SPACE;
+
+           uint16_t newAddress;
+           r = logAppend(vol, workingHeader.file.fileID, 0, size, NULL, workingAddress + sizeof(logHeader), &newAddress);
+
+           if (r != NO_ERROR)
+               return r;
+
+           indexRemove(workingAddress);
+           indexInsert(workingHeader.file.fileID, newAddress);
+
+           *cost += sizeof(logHeader) + 2 * size;
        } else {
-           *(filenameOut+i) = inChar;
+           uint16_t dropped = sizeof(logHeader) + size;
+           vol->deletedSpace = dropped < vol->deletedSpace ? vol->deletedSpace - dropped : 0;
        }
    }
+
+   vol->tail = logNext(vol, workingAddress, &workingHeader.file);
+   vol->freeSpace = logFreeSpace(vol);
+
+   return NO_ERROR;
 }
@@ -6,15 +6,15 @@
  *
  * Method:
  *
- * This library has no support for fragmented files or directories. File names
- * are in 8.3 format: 8 chars followed by 3 for an extension. Filenames will be
- * padded to 8 chars by spaces.
+ * This library has no support for fragmented files or directories. Files are
+ * known by a 16 bit ID instead of a name, which the application picks; the ID
+ * OSFS_NO_ID is kept for the empty headers OSFS writes itself.
  *
- * Each file has a header of n bytes:
+ * Each file has a header of 7 bytes:
  *
  * -----------------------
  * HEADER
- * 	File ID and extension (8+3 bytes)
+ * 	File ID (uint16_t = 2 bytes)
  * 	Size of file (uint16_t = 2 bytes)
  * 	Pointer to start of next file's header (uint16_t = 2 bytes)
  * 	Flags (uint8_t = 1 bytes. MSB = 1 for deleted file, 0 for valid. Other bits reserved)
@@ -27,6 +27,23 @@
  * necessarily fill all the available space, e.g. if it has been overwritten
  * with a smaller file. Overwriting with a larger file is not supported yet,
  * since file fragmentation is not supported.
+ *
+ * Log-structured volumes:
+ *
+ * A volume formatted with formatLog() is written as a log instead. Records
+ * are appended one after the other, going back to the start when the end of
+ * the EEPROM is reached, so that writes are spread over all of it. A record is
+ * never written to again once it is in: overwriting a file appends a newer
+ * record of it, of any size, and deleting one appends a deleted record with
+ * its ID. Each record header is that of a file followed by:
+ *
+ * 	Address of the oldest record in the log (uint16_t = 2 bytes)
+ *
+ * with <pointer to next> holding a sequence number instead, one more than the
+ * record before it. mount() finds the newest record by following the sequence
+ * numbers from the start of the EEPROM, and replays the log from the oldest
+ * record it points to. compact() reclaims records from the oldest end of the
+ * log, copying the ones still current to the newest end.
  */
 
 /*
@@ -39,52 +56,145 @@
 
 #pragma once
 
-#include <avr/eeprom.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 typedef char byte;
 
-// User provided details about the EEPROM
+typedef enum {
+    NO_ERROR = 0,
+    WRONG_VERSION,
+    UNCAUGHT_OOR,
+    FILE_NOT_FOUND,
+    INSUFFICIENT_SPACE,
+    UNFORMATTED,
+    BUFFER_WRONG_SIZE,
+    FILE_ALREADY_EXISTS,
+    NOT_MOUNTED,
+    READ_ONLY,
+    BUSY,
+    UNDEFINED_ERROR
+} result;
+
+// Where a volume is stored. OSFS reads and writes it through the backend
+// passed to useBackend(), between addresses <start> and <end>. Address 0 is
+// never used, since it marks the end of the file chain. Ready-made backends
+// are declared in OSFS_backends.h. read() and write() return what stopped
+// them, e.g. BUSY if another task is using the storage.
+typedef struct osfsBackend {
+    result (*read)(uint16_t address, unsigned int num, byte* output);
+    result (*write)(uint16_t address, unsigned int num, const byte* input); // NULL if read-only
+    uint16_t start;
+    uint16_t end;
+    uint16_t eraseBlock; // Bytes erased together by write(), 0 if each is written on its own
+} osfsBackend;
+
+// The range of the backend in use
 extern uint16_t startOfEEPROM;
 extern uint16_t endOfEEPROM;
-extern void readNBytes(uint16_t address, unsigned int num, byte* output);
-extern void writeNBytes(uint16_t address, unsigned int num, const byte* input);
 
-typedef struct fileHeader {
-    char fileID[11]; // Note that this string is not null terminated
+// The headers are stored exactly as laid out in memory. They are packed, so
+// that a volume written on the host reads back on the AVR: both are little
+// endian, but the host would otherwise pad them to an even size.
+typedef struct __attribute__((packed)) fileHeader {
+    uint16_t fileID; // OSFS_NO_ID for empty and deleted placeholders
     uint16_t fileSize;
     uint16_t nextFile; // = 0 if no next file
     uint8_t flags; // MSB = 1 for deleted file, 0 for valid. Other bits reserved
 } fileHeader;
 
-typedef struct FSInfo {
+typedef struct __attribute__((packed)) logHeader {
+    fileHeader file; // file.nextFile holds the sequence number of the record
+    uint16_t tail;   // Oldest record of the log when this one was written
+} logHeader;
+
+typedef struct __attribute__((packed)) FSInfo {
     char idStr[4]; // Note that this string is not null terminated
     uint16_t version;
 } FSInfo;
 
 // Flag meaning
 extern const int DELBIT;
-
-typedef enum {
-    NO_ERROR = 0,
-    WRONG_VERSION,
-    UNCAUGHT_OOR,
-    FILE_NOT_FOUND,
-    INSUFFICIENT_SPACE,
-    UNFORMATTED,
-    BUFFER_WRONG_SIZE,
-    FILE_ALREADY_EXISTS,
-    UNDEFINED_ERROR
-} result;
+extern const int WRAPBIT; // Log volumes: the log carries on at the start
 
 #define OSFS_ID_STR "OSFS"
-#define OSFS_VER 2
+#define OSFS_VER 3
+#define OSFS_LOG_VER 4
+
+// ID of the empty files marking free space, gaps and wraps. No file takes it.
+#define OSFS_NO_ID 0xFFFF
+
+// Slots in the in-RAM index of file headers. Lookups fall back to walking the
+// file chain if there are ever more files than slots.
+#define OSFS_INDEX_SIZE 32
+
+// Largest file a log volume takes. Records are copied whole by compact(), and
+// room is kept free for it to copy the largest one. Log volumes also hold at
+// most OSFS_INDEX_SIZE files, since only the index tells current records from
+// superseded ones.
+#define OSFS_LOG_MAX_FILE 96
+
+// compact() only reclaims records of a log volume once its free space falls
+// below this, since copying the current ones forward wears the EEPROM too
+#define OSFS_LOG_CLEAN_BELOW 1024
+
+/**
+ * A mounted volume. The FSInfo header is checked once by mount(), which also
+ * walks the file chain to find where it ends, so file operations neither
+ * check the header again nor walk the chain to append.
+ */
+typedef struct osfsVolume {
+    uint16_t version;
+    uint16_t head;         // Address of the first file header
+    uint16_t tail;         // Address of the last file header
+    uint16_t end;          // Address the next file will be written to
+    uint16_t freeSpace;    // Bytes left after the end of the last file
+    uint16_t deletedSpace; // Bytes before the end not taken up by live files
+    uint8_t mounted;
+
+    // Log volumes use head for the start of the log area, tail for the
+    // oldest record and end for where the next one goes. freeSpace is what
+    // lies between end and tail, and deletedSpace the bytes of superseded
+    // and deleted records between tail and end.
+    uint16_t nextSeq;      // Sequence number of the next record
+
+    // Progress of compact(). compactNext is 0 between passes.
+    uint16_t compactNext;  // Next header to look at
+    uint16_t compactPrev;  // Last live header already in place, 0 if none
+    uint16_t compactEnd;   // Where the next live file belongs
+    uint16_t moveFrom;     // Header of the file being moved, 0 if none
+    uint16_t moveDone;     // Bytes of its contents moved so far
+} osfsVolume;
+
+/**
+ * @brief      Mount the EEPROM
+ *
+ *             Checks that the EEPROM is managed by this version of the
+ *             library, indexes its files and fills in <vol>, which the file
+ *             operations then take.
+ *
+ * @param[out] vol   The volume
+ *
+ * @return     Error status.
+ */
+result mount(osfsVolume* vol);
+
+/**
+ * @brief      Select where volumes are stored
+ *
+ *             All file operations go through <backend> from here on, and
+ *             volumes mounted from another backend have to be mounted again.
+ *
+ * @param[in]  backend  The backend, which must outlive its use
+ */
+void useBackend(const osfsBackend* backend);
 
 /**
  * @brief      Write N bytes to the EEPROM
  *
- *             Uses the user-provided function writeNBytes to write to the ROM,
- *             first checking that we're staying within the limits
+ *             Uses the backend to write to the ROM, first checking that we're
+ *             staying within the limits and that it can be written to
  *
  * @param[in]  address  The address
  * @param[in]  num      The number
@@ -97,8 +207,8 @@ result writeNBytesChk(uint16_t address, unsigned int num, const void* input);
 /**
  * @brief      Reads N bytes from the EEPROM
  *
- *             Uses the user-provided function readNBytes to read from the ROM,
- *             first checking that we're staying within the limits
+ *             Uses the backend to read from the ROM, first checking that
+ *             we're staying within the limits
  *
  * @param[in]  address  The address
  * @param[in]  num      The number
@@ -111,81 +221,187 @@ result readNBytesChk(uint16_t address, unsigned int num, void* input);
 /**
  * @brief      Gets a pointer to the given file
  *
- *             Looks for the file specified by filename. If found, stores a
+ *             Looks for the file with the given ID. If found, stores a
  *             pointer to this file and its size in filePointer and fileSize.
  *
- * @param      filename     The filename. Should be 11 chars long. More chars
- *                          will be ignored, less chars will be padded to 11.
+ *             Files are found through an index kept in RAM, which is built by
+ *             mount() and kept up to date by newFile() and deleteFile().
+ *
+ * @param      vol          The mounted volume
+ * @param      fileID       The file ID
  * @param[out] filePointer  The file pointer
  * @param[out] fileSize     The file size
  *
  * @return     Error status.
  */
-result getFileInfo(const char* filename, uint16_t* filePointer, uint16_t* fileSize);
+result getFileInfo(const osfsVolume* vol, uint16_t fileID, uint16_t* filePointer, uint16_t* fileSize);
 
 /**
  * @brief      Reads out the given file into an output buffer
  *
- *             This function will check that the output variable is of the right
- *             size to fit the data
+ *             This function will check that the output buffer is large enough
+ *             to fit the data. Files can be of any size up to <buf_size>.
  *
- * @param[in]  filename  The filename
+ * @param      vol       The mounted volume
+ * @param[in]  fileID    The file ID
  * @param[out] buf       The output buffer
+ * @param[in]  buf_size  The size of the output buffer
+ * @param[out] length    The number of bytes read, i.e. the size of the file
  *
  * @return     Error status.
  */
-inline result getFile(const char* filename, char* buf, size_t buf_size) {
+inline result getFile(const osfsVolume* vol, uint16_t fileID, char* buf, size_t buf_size, uint16_t* length) {
     uint16_t add, size;
-    result r = getFileInfo(filename, &add, &size);
+    result r = getFileInfo(vol, fileID, &add, &size);
 
     if (r != NO_ERROR)
         return r;
 
-    if (size != buf_size)
+    if (size > buf_size)
         return BUFFER_WRONG_SIZE;
 
+    *length = size;
+
     return readNBytesChk(add, size, buf);
 }
 
+/**
+ * @brief      Reads part of the given file
+ *
+ *             Reads up to <length> bytes starting <offset> bytes into the
+ *             file, so that files larger than any buffer can be read in
+ *             chunks. Fewer bytes are read at the end of the file, and none
+ *             past it.
+ *
+ * @param      vol       The mounted volume
+ * @param[in]  fileID    The file ID
+ * @param[in]  offset    The offset of the first byte to read
+ * @param[out] buf       The output buffer, of at least <length> bytes
+ * @param[in]  length    The number of bytes to read
+ * @param[out] read      The number of bytes read
+ *
+ * @return     Error status.
+ */
+result readFile(const osfsVolume* vol, uint16_t fileID, uint16_t offset, char* buf, uint16_t length, uint16_t* read);
+
 /**
  * @brief      Store a new file
  *
- *             Create and store a new file in the EEPROM using the given
- *             filename. If sufficient continuous space is found, store <size>
- *             bytes starting at <data> in the EEPROM.
+ *             Create and store a new file in the EEPROM under the given ID.
+ *             If there is sufficient space after the last file,
+ *             store <size> bytes starting at <data> there.
  *
- *             It is recommended to use the other form of this function.
+ *             On a log volume, an existing file can be overwritten with a
+ *             new one of any size up to OSFS_LOG_MAX_FILE.
  *
- * @param      filename  The filename. Should be 11 chars long. More chars will
- *                       be ignored, less chars will be padded to 11.
+ * @param      vol       The mounted volume
+ * @param      fileID    The file ID. Any but OSFS_NO_ID.
  * @param      data      Pointer to the data to be stored.
  * @param      size      Number of bytes to store, starting at `data`.
  *
  * @return     Error status.
  */
-result newFile(const char* filename, const char* data, unsigned int size, uint8_t overwrite);
+result newFile(osfsVolume* vol, uint16_t fileID, const char* data, unsigned int size, uint8_t overwrite);
+
+typedef struct newFileEntry {
+    uint16_t fileID;
+    const char* data;
+    unsigned int size;
+    result status; // Set by newFiles()
+} newFileEntry;
+
+/**
+ * @brief      Store a batch of new files
+ *
+ *             Appends the given files after the last one in a single pass,
+ *             linking them into the chain only once all of them have been
+ *             written. Each file's outcome is stored in its <status>: files
+ *             whose ID is taken get FILE_ALREADY_EXISTS and are skipped,
+ *             and if the rest do not all fit none of them are stored and they
+ *             get INSUFFICIENT_SPACE.
+ *
+ *             On a log volume the files are stored one at a time, and the
+ *             ones that do not fit get INSUFFICIENT_SPACE on their own.
+ *
+ * @param      vol    The mounted volume
+ * @param      files  The files to store
+ * @param[in]  count  The number of files
+ *
+ * @return     Error status of the batch as a whole.
+ */
+result newFiles(osfsVolume* vol, newFileEntry* files, uint8_t count);
 
 /**
  * @brief      Deletes the file given
  *
  *             Marks the given file as deleted if found.
  *
- * @param      filename  The filename
+ * @param      vol       The mounted volume
+ * @param      fileID    The file ID
  *
  * @return     Error status
  */
-result deleteFile(const char* filename);
+result deleteFile(osfsVolume* vol, uint16_t fileID);
+
+/**
+ * @brief      Reclaim the space of deleted files, a little at a time
+ *
+ *             Deleted files are unlinked from the chain, merging runs of them
+ *             into one gap, and the live files after them are moved down to
+ *             close it, until the free space is all after the last file.
+ *             Each call moves at most <budget> bytes and carries on from where
+ *             the previous one stopped, so that it can be called whenever
+ *             there is time to spare. A file whose new place overlaps its old
+ *             one is moved in a single call however large it is, since it
+ *             cannot be read in between.
+ *
+ *             Calls return straight away while nothing is deleted.
+ *
+ *             Files move, so an address from getFileInfo() is only good until
+ *             the next call. Readers that can be interrupted by compaction,
+ *             e.g. in a task it preempts, get another file's bytes: call it
+ *             from the task that reads the volume, or keep the two apart.
+ *
+ *             On a log volume, records are reclaimed from the oldest one on,
+ *             copying the ones still current to the end of the log, but only
+ *             while the free space is below OSFS_LOG_CLEAN_BELOW. Files
+ *             that do not fit otherwise have records reclaimed for them
+ *             straight away.
+ *
+ * @param      vol     The mounted volume
+ * @param[in]  budget  Maximum number of bytes to move
+ *
+ * @return     Error status.
+ */
+result compact(osfsVolume* vol, uint16_t budget);
 
 /**
  * @brief      Format the EEPROM
  *
  *             Clear all data from the EEPROM, readying it for use with this
  *             library. This does not actually erase the EEPROM, only writes to
- *             the FSInfo header and the first file block.
+ *             the FSInfo header and the first file block. The empty volume is
+ *             then mounted into <vol>.
+ *
+ * @param[out] vol   The volume
  *
  * @return     Error status.
  */
-result format();
+result format(osfsVolume* vol);
+
+/**
+ * @brief      Format the EEPROM as a log-structured volume
+ *
+ *             Like format(), but for a volume that is written as a log, see
+ *             above. The sequence numbers of a log already on the EEPROM are
+ *             carried on from, so that none of its records are mistaken for
+ *             part of the new one.
+ *
+ * @param[out] vol   The volume
+ *
+ * @return     Error status.
+ */
+result formatLog(osfsVolume* vol);
 
 /**
  * @brief      Checks that the EEPROM is managed by this library
@@ -195,15 +411,13 @@ result format();
  *
  * @return     Error status
  */
-result checkLibVersionInternal(uint16_t ver);
+result checkLibVersionInternal(uint16_t* ver);
 
 inline result checkLibVersion() {
     uint16_t dummy;
-    return checkLibVersionInternal(dummy);
+    return checkLibVersionInternal(&dummy);
 }
 
-void padFilename(const char * filenameIn, char * filenameOut);
-
-inline uint8_t isDeletedFile(fileHeader workingHeader) {
-    return workingHeader.flags && 1<<DELBIT;
+static inline uint8_t isDeletedFile(fileHeader workingHeader) {
+    return (workingHeader.flags & 1<<DELBIT) != 0;
 }
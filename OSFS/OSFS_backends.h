@@ -0,0 +1,127 @@
+/**
+ * Storage backends for OSFS, to pass to useBackend().
+ */
+
+#pragma once
+
+#include "OSFS.h"
+
+#ifdef OSFS_EEPROM
+
+// The EEPROM of the AVR, from address 1 to its end. Writes are queued and
+// programmed in the background by the EE_READY interrupt, and reads see
+// queued bytes as if already written. Only built with OSFS_EEPROM, which the
+// game does not use.
+extern const osfsBackend eepromBackend;
+
+// Bytes that can wait to be programmed into the EEPROM. Must divide 256.
+#define OSFS_WRITE_QUEUE_SIZE 128
+
+// Regions the EEPROM is split into for getWriteCount()
+#define OSFS_WEAR_REGIONS 16
+
+/**
+ * @brief      Wait for all queued writes to reach the EEPROM
+ *
+ *             A barrier for before anything that would lose the queue, such
+ *             as a reset. Works with interrupts enabled or disabled.
+ */
+void flushWrites();
+
+/**
+ * @brief      Number of bytes programmed into a region of the EEPROM
+ *
+ *             Counts, since reset, the bytes actually programmed into each of
+ *             OSFS_WEAR_REGIONS equal parts of the EEPROM. Bytes written with
+ *             the value they already held are not programmed and not counted.
+ *             Counts stop at 0xFFFF.
+ *
+ * @param[in]  region  The region, from 0 for the one at address 0
+ *
+ * @return     The number of bytes programmed.
+ */
+uint16_t getWriteCount(uint8_t region);
+
+#endif
+
+#ifdef __AVR__
+
+#include <avr/pgmspace.h>
+
+/**
+ * @brief      Set up a read-only backend for a volume image in flash
+ *
+ *             Immutable content can be kept in program memory, of which
+ *             there is far more than EEPROM. Address 0 of the volume is the
+ *             first byte of <image>, which can lie anywhere in flash, also
+ *             above the first 64 KB. Writing to the volume fails with
+ *             READ_ONLY.
+ *
+ * @param[out] backend  The backend
+ * @param[in]  image    The image, in PROGMEM, from pgm_get_far_address()
+ * @param[in]  size     The size of the image
+ */
+void progmemBackend(osfsBackend* backend, uint_farptr_t image, uint16_t size);
+
+#endif
+
+// Sectors of an SD card cached in RAM, of 512 bytes each
+#define SD_CACHE_SECTORS 2
+
+/**
+ * @brief      Set up a backend for a volume on an SD card
+ *
+ *             Brings up the card and stores the volume on it from sector
+ *             <first> on, unformatted by any other file system, e.g. as
+ *             written by dd. The sectors last used are cached, and reading
+ *             one from the card reads the one after it too. Writes change
+ *             the cache, and reach the card when a sector is evicted or on
+ *             sdFlush().
+ *
+ *             Transfers run with interrupts enabled. One task uses the card
+ *             at a time, and the others get BUSY until it is done; see
+ *             sdBusy().
+ *
+ * @param[out] backend  The backend
+ * @param[in]  first    The first sector of the volume
+ * @param[in]  size     The size of the volume
+ *
+ * @return     Error status. NOT_MOUNTED if there is no card.
+ */
+result sdBackend(osfsBackend* backend, uint32_t first, uint16_t size);
+
+/**
+ * @brief      Write the sectors changed in the cache to the card
+ *
+ * @return     Error status.
+ */
+result sdFlush();
+
+/**
+ * @brief      Whether a task is using the card
+ *
+ *             A task that can preempt another using the card should check
+ *             this and come back later, rather than get BUSY halfway through
+ *             its work.
+ *
+ * @return     1 while the card is in use, 0 otherwise.
+ */
+uint8_t sdBusy();
+
+#ifndef __AVR__
+
+/**
+ * @brief      Set up a backend for a volume kept in a file, for host builds
+ *
+ *             The file is created if it does not exist, and filled up to
+ *             <size> bytes with 0xFF like erased EEPROM.
+ *
+ * @param[out] backend  The backend
+ * @param[in]  path     The file
+ * @param[in]  size     The size of the volume
+ *
+ * @return     Error status.
+ */
+result fileBackend(osfsBackend* backend, const char* path, uint16_t size);
+
+#endif
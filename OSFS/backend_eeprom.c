@@ -0,0 +1,167 @@
+/**
+* EEPROM backend for OSFS
+*/
+
+#include "OSFS_backends.h"
+
+// Only built with OSFS_EEPROM, so that builds not using it are spared the
+// interrupt and the RAM of the queue
+#ifdef OSFS_EEPROM
+
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+// Write-behind queue of bytes waiting to be programmed into the EEPROM, oldest
+// first. It is drained by the EE_READY interrupt, one byte per programming
+// cycle. Both indices only ever increase; the queue size divides 256.
+typedef struct pendingWrite {
+    uint16_t address;
+    uint8_t value;
+} pendingWrite;
+
+static pendingWrite writeQueue[OSFS_WRITE_QUEUE_SIZE];
+static volatile uint8_t writeHead = 0;
+static volatile uint8_t writeTail = 0;
+
+static uint8_t programNextByte();
+static result eepromRead(uint16_t address, unsigned int num, byte* output);
+static result eepromWrite(uint16_t address, unsigned int num, const byte* input);
+
+const osfsBackend eepromBackend = {eepromRead, eepromWrite, 1, E2END + 1, 0};
+
+// Bytes programmed into each region of the EEPROM since reset
+static uint16_t writeCounts[OSFS_WEAR_REGIONS];
+
+static result eepromRead(uint16_t address, unsigned int num, byte* output) {
+    uint8_t sreg = SREG;
+    uint8_t head;
+    uint8_t wrapped;
+
+    do {
+        cli();
+        head = writeHead;
+        SREG = sreg;
+
+        for (unsigned int i = 0; i < num; i++) {
+
+            // The EEPROM can't be read while it programs a byte. The wait is
+            // done with interrupts on, and checked again with them off,
+            // since the interrupt may start the next byte after it.
+            for (;;) {
+                eeprom_busy_wait();
+                cli();
+                if (eeprom_is_ready())
+                    break;
+                SREG = sreg;
+            }
+
+            EEAR = address + i;
+            EECR |= _BV(EERE);
+            output[i] = EEDR;
+            SREG = sreg;
+        }
+
+        cli();
+
+        // Bytes queued since <head> are read from the queue instead, the
+        // newest write of each winning. Those programmed while reading stay
+        // in their slot unless the queue went all the way round, in which
+        // case the read is done again.
+        wrapped = (uint8_t) (writeTail - head) > OSFS_WRITE_QUEUE_SIZE;
+        if (!wrapped) {
+            for (uint8_t i = head; i != writeTail; i++) {
+                pendingWrite* w = &writeQueue[i % OSFS_WRITE_QUEUE_SIZE];
+                if (w->address >= address && w->address < address + num)
+                    output[w->address - address] = w->value;
+            }
+        }
+
+        SREG = sreg;
+    } while (wrapped);
+
+    return NO_ERROR;
+}
+
+static result eepromWrite(uint16_t address, unsigned int num, const byte* input) {
+    for (unsigned int i = 0; i < num; i++) {
+
+        // Only a full queue holds the writer up. With interrupts disabled,
+        // e.g. before the scheduler starts, it is drained right here.
+        while ((uint8_t) (writeTail - writeHead) == OSFS_WRITE_QUEUE_SIZE) {
+            if (!(SREG & _BV(SREG_I))) {
+                eeprom_busy_wait();
+                programNextByte();
+            }
+        }
+
+        pendingWrite* w = &writeQueue[writeTail % OSFS_WRITE_QUEUE_SIZE];
+        w->address = address + i;
+        w->value = input[i];
+        writeTail++;
+
+        // The interrupt turns itself off whenever it finds the queue empty,
+        // so it is turned back on for every byte, and the wait above for a
+        // full queue never waits on it while it is off
+        EECR |= _BV(EERIE);
+    }
+
+    return NO_ERROR;
+}
+
+void flushWrites() {
+    while (writeHead != writeTail) {
+        if (!(SREG & _BV(SREG_I))) {
+            eeprom_busy_wait();
+            programNextByte();
+        }
+    }
+
+    eeprom_busy_wait();
+}
+
+// Start programming the next queued byte that differs from what the EEPROM
+// holds. Must be called with interrupts disabled and the EEPROM ready.
+// Returns 0 once the queue is empty.
+static uint8_t programNextByte() {
+    while (writeHead != writeTail) {
+        pendingWrite* w = &writeQueue[writeHead % OSFS_WRITE_QUEUE_SIZE];
+
+        EEAR = w->address;
+        EECR |= _BV(EERE);
+
+        if (EEDR != w->value) {
+            uint16_t* count = &writeCounts[w->address / ((E2END + 1) / OSFS_WEAR_REGIONS)];
+            if (*count != 0xFFFF)
+                (*count)++;
+
+            EEDR = w->value;
+            EECR |= _BV(EEMPE);
+            EECR |= _BV(EEPE);
+            writeHead++;
+            return 1;
+        }
+
+        writeHead++;
+    }
+
+    return 0;
+}
+
+ISR(EE_READY_vect) {
+    if (!programNextByte())
+        EECR &= ~_BV(EERIE);
+}
+
+uint16_t getWriteCount(uint8_t region) {
+    if (region >= OSFS_WEAR_REGIONS)
+        return 0;
+
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = writeCounts[region];
+    SREG = sreg;
+
+    return count;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/**
+* File backend for OSFS, for host builds
+*/
+
+#include "OSFS_backends.h"
+
+#ifndef __AVR__
+
+#include <stdio.h>
+
+static FILE* volumeFile;
+
+static result fileRead(uint16_t address, unsigned int num, byte* output) {
+    if (fseek(volumeFile, address, SEEK_SET) != 0)
+        return UNDEFINED_ERROR;
+
+    if (fread(output, 1, num, volumeFile) != num)
+        memset(output, 0xFF, num);
+
+    return NO_ERROR;
+}
+
+static result fileWrite(uint16_t address, unsigned int num, const byte* input) {
+    if (fseek(volumeFile, address, SEEK_SET) != 0)
+        return UNDEFINED_ERROR;
+
+    if (fwrite(input, 1, num, volumeFile) != num || fflush(volumeFile) != 0)
+        return UNDEFINED_ERROR;
+
+    return NO_ERROR;
+}
+
+result fileBackend(osfsBackend* backend, const char* path, uint16_t size) {
+    if (volumeFile != NULL)
+        fclose(volumeFile);
+
+    volumeFile = fopen(path, "r+b");
+
+    if (volumeFile == NULL)
+        volumeFile = fopen(path, "w+b");
+
+    if (volumeFile == NULL)
+        return UNDEFINED_ERROR;
+
+    // Fill the volume up to its size like erased EEPROM
+    if (fseek(volumeFile, 0, SEEK_END) != 0)
+        return UNDEFINED_ERROR;
+
+    for (long length = ftell(volumeFile); length < size; length++)
+        fputc(0xFF, volumeFile);
+
+    if (fflush(volumeFile) != 0)
+        return UNDEFINED_ERROR;
+
+    backend->read = fileRead;
+    backend->write = fileWrite;
+    backend->start = 1;
+    backend->end = size;
+    backend->eraseBlock = 0;
+
+    return NO_ERROR;
+}
+
+#endif
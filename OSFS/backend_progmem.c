@@ -0,0 +1,26 @@
+/**
+* Read-only flash backend for OSFS
+*/
+
+#include "OSFS_backends.h"
+
+#ifdef __AVR__
+
+static uint_farptr_t progmemImage;
+
+static result progmemRead(uint16_t address, unsigned int num, byte* output) {
+    memcpy_PF(output, progmemImage + address, num);
+    return NO_ERROR;
+}
+
+void progmemBackend(osfsBackend* backend, uint_farptr_t image, uint16_t size) {
+    progmemImage = image;
+
+    backend->read = progmemRead;
+    backend->write = NULL;
+    backend->start = 1;
+    backend->end = size;
+    backend->eraseBlock = 0;
+}
+
+#endif
@@ -0,0 +1,246 @@
+/**
+* SD card backend for OSFS
+*/
+
+#include "OSFS_backends.h"
+#include "sd_card.h"
+
+#ifdef __AVR__
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+
+// A sector of the card held in RAM. Writes only change the cached copy, and
+// reach the card when it is evicted or flushed.
+typedef struct cachedSector {
+    uint32_t sector;
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t age; // Accesses to other sectors since the last to this one
+    uint8_t data[SD_SECTOR_SIZE];
+} cachedSector;
+
+static cachedSector sectorCache[SD_CACHE_SECTORS];
+
+// Where the volume is on the card, in sectors
+static uint32_t firstSector;
+static uint32_t lastSector;
+
+// The card is shared by every task that reads or writes files, and a transfer
+// cannot be interrupted by another one. Set while a task uses the card: a task
+// preempting it gets BUSY instead of waiting, which it never could, since the
+// one it preempted only carries on once it returns.
+static volatile uint8_t cardBusy;
+
+static uint8_t claimCard() {
+#ifdef __AVR__
+    uint8_t sreg = SREG;
+    cli();
+#endif
+
+    uint8_t claimed = !cardBusy;
+    cardBusy = 1;
+
+#ifdef __AVR__
+    SREG = sreg;
+#endif
+
+    return claimed;
+}
+
+static void releaseCard() {
+    cardBusy = 0;
+}
+
+uint8_t sdBusy() {
+    return cardBusy;
+}
+
+static result writeBack(cachedSector* cached) {
+    if (!cached->valid || !cached->dirty)
+        return NO_ERROR;
+
+    result r = sdWriteSector(cached->sector, cached->data);
+
+    if (r == NO_ERROR)
+        cached->dirty = 0;
+
+    return r;
+}
+
+static void touch(cachedSector* cached) {
+    for (uint8_t i = 0; i < SD_CACHE_SECTORS; i++)
+        if (sectorCache[i].age != 0xFF)
+            sectorCache[i].age++;
+
+    cached->age = 0;
+}
+
+static cachedSector* findSector(uint32_t sector) {
+    for (uint8_t i = 0; i < SD_CACHE_SECTORS; i++)
+        if (sectorCache[i].valid && sectorCache[i].sector == sector)
+            return &sectorCache[i];
+
+    return NULL;
+}
+
+// Read <sector> into the least recently used entry, other than <keep>
+static result loadSector(uint32_t sector, const cachedSector* keep, cachedSector** loaded) {
+    cachedSector* victim = NULL;
+
+    for (uint8_t i = 0; i < SD_CACHE_SECTORS; i++) {
+        cachedSector* cached = &sectorCache[i];
+
+        if (cached == keep)
+            continue;
+
+        if (!cached->valid) {
+            victim = cached;
+            break;
+        }
+
+        if (victim == NULL || cached->age > victim->age)
+            victim = cached;
+    }
+
+    result r = writeBack(victim);
+
+    if (r == NO_ERROR) {
+        victim->valid = 0;
+        r = sdReadSector(sector, victim->data);
+    }
+
+    if (r != NO_ERROR)
+        return r;
+
+    victim->sector = sector;
+    victim->valid = 1;
+    victim->dirty = 0;
+    touch(victim);
+
+    *loaded = victim;
+    return NO_ERROR;
+}
+
+// The cached copy of <sector>. A sector read from the card brings the one
+// after it in too, so that reading on through a file finds it cached.
+static result getSector(uint32_t sector, uint8_t readAhead, cachedSector** cached) {
+    *cached = findSector(sector);
+
+    if (*cached != NULL) {
+        touch(*cached);
+        return NO_ERROR;
+    }
+
+    result r = loadSector(sector, NULL, cached);
+
+    if (r != NO_ERROR || !readAhead || SD_CACHE_SECTORS < 2)
+        return r;
+
+    // A sector that cannot be read ahead is read again when needed
+    if (sector < lastSector && findSector(sector + 1) == NULL) {
+        cachedSector* ahead;
+        loadSector(sector + 1, *cached, &ahead);
+        touch(*cached);
+    }
+
+    return NO_ERROR;
+}
+
+static result sdRead(uint16_t address, unsigned int num, byte* output) {
+    if (!claimCard())
+        return BUSY;
+
+    result r = NO_ERROR;
+
+    while (num > 0 && r == NO_ERROR) {
+        uint16_t offset = address % SD_SECTOR_SIZE;
+        uint16_t length = SD_SECTOR_SIZE - offset;
+
+        if (length > num)
+            length = num;
+
+        cachedSector* cached;
+        r = getSector(firstSector + address / SD_SECTOR_SIZE, 1, &cached);
+
+        if (r == NO_ERROR)
+            memcpy(output, cached->data + offset, length);
+
+        address += length;
+        output += length;
+        num -= length;
+    }
+
+    releaseCard();
+    return r;
+}
+
+static result sdWrite(uint16_t address, unsigned int num, const byte* input) {
+    if (!claimCard())
+        return BUSY;
+
+    result r = NO_ERROR;
+
+    while (num > 0 && r == NO_ERROR) {
+        uint16_t offset = address % SD_SECTOR_SIZE;
+        uint16_t length = SD_SECTOR_SIZE - offset;
+
+        if (length > num)
+            length = num;
+
+        cachedSector* cached;
+        r = getSector(firstSector + address / SD_SECTOR_SIZE, 0, &cached);
+
+        if (r == NO_ERROR) {
+            memcpy(cached->data + offset, input, length);
+            cached->dirty = 1;
+        }
+
+        address += length;
+        input += length;
+        num -= length;
+    }
+
+    releaseCard();
+    return r;
+}
+
+result sdFlush() {
+    if (!claimCard())
+        return BUSY;
+
+    result r = NO_ERROR;
+
+    for (uint8_t i = 0; i < SD_CACHE_SECTORS && r == NO_ERROR; i++)
+        r = writeBack(&sectorCache[i]);
+
+    releaseCard();
+    return r;
+}
+
+result sdBackend(osfsBackend* backend, uint32_t first, uint16_t size) {
+    if (!claimCard())
+        return BUSY;
+
+    result r = sdCardInit();
+
+    // Whatever was cached may be from another card
+    for (uint8_t i = 0; i < SD_CACHE_SECTORS; i++)
+        sectorCache[i].valid = 0;
+
+    releaseCard();
+
+    if (r != NO_ERROR)
+        return r;
+
+    firstSector = first;
+    lastSector = first + (size - 1) / SD_SECTOR_SIZE;
+
+    backend->read = sdRead;
+    backend->write = sdWrite;
+    backend->start = 1;
+    backend->end = size;
+    backend->eraseBlock = SD_SECTOR_SIZE;
+
+    return NO_ERROR;
+}
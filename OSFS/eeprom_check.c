@@ -0,0 +1,51 @@
+#include <avr/interrupt.h>
+#include "lcd.h"
+#include "OSFS_backends.h"
+#include "eeprom_check.h"
+
+#ifdef EEPROM_CHECK
+
+static byte check_buffer[EEPROM_CHECK_LENGTH];
+
+/* Returns 1 if <length> bytes written from <address> read back. */
+static uint8_t check_run(uint16_t address, uint8_t seed)
+{
+    uint16_t i;
+
+    for(i=0; i<EEPROM_CHECK_LENGTH; i++)
+        check_buffer[i] = (byte) (seed + i);
+
+    /* Hangs here if the queue is never drained. */
+    if (eepromBackend.write(address, EEPROM_CHECK_LENGTH, check_buffer) != NO_ERROR)
+        return 0;
+
+    flushWrites();
+
+    for(i=0; i<EEPROM_CHECK_LENGTH; i++)
+        check_buffer[i] = 0;
+
+    if (eepromBackend.read(address, EEPROM_CHECK_LENGTH, check_buffer) != NO_ERROR)
+        return 0;
+
+    for(i=0; i<EEPROM_CHECK_LENGTH; i++)
+        if (check_buffer[i] != (byte) (seed + i))
+            return 0;
+
+    return 1;
+}
+
+void run_eeprom_check(void)
+{
+    uint8_t ok;
+
+    sei();
+
+    /* First on an idle queue, then just after it has drained. */
+    ok = check_run(eepromBackend.start, 0x5A);
+    ok = ok && check_run(eepromBackend.start + EEPROM_CHECK_LENGTH, 0xA5);
+
+    display_string("eeprom queue ", WHITE);
+    display_string(ok ? "ok" : "FAILED", ok ? GREEN : RED);
+}
+
+#endif /* EEPROM_CHECK */
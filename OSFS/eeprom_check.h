@@ -0,0 +1,25 @@
+/*
+ * On-target check of the EEPROM backend's write queue.
+ *
+ * Writes runs longer than the queue through eepromBackend with interrupts
+ * enabled, once on an idle queue and once right after it has drained and the
+ * EE_READY interrupt has turned itself off, and reads them back. The outcome
+ * is written on the screen. Built into the firmware in place of the game when
+ * EEPROM_CHECK is defined; it overwrites the start of the EEPROM.
+ */
+
+#ifndef EEPROM_CHECK_H
+#define EEPROM_CHECK_H
+
+#include "OSFS_backends.h"
+
+#if defined(EEPROM_CHECK) && !defined(OSFS_EEPROM)
+#error "EEPROM_CHECK needs the EEPROM backend, built with OSFS_EEPROM"
+#endif
+
+/* Bytes written by each run, more than fit in the queue at once. */
+#define EEPROM_CHECK_LENGTH (2 * OSFS_WRITE_QUEUE_SIZE + 1)
+
+void run_eeprom_check(void);
+
+#endif /* EEPROM_CHECK_H */
@@ -0,0 +1,221 @@
+/**
+* SD card access for OSFS over SPI
+*/
+
+#include "sd_card.h"
+
+#ifdef __AVR__
+
+#include <avr/io.h>
+
+#define SD_CS   PB0
+#define SD_SCK  PB1
+#define SD_MOSI PB2
+#define SD_MISO PB3
+#define SD_CD   PB6 // Closed, i.e. low, with a card in the slot
+
+#define CMD_GO_IDLE_STATE      0
+#define CMD_SEND_IF_COND       8
+#define CMD_SET_BLOCKLEN       16
+#define CMD_READ_SINGLE_BLOCK  17
+#define CMD_WRITE_BLOCK        24
+#define CMD_APP_CMD            55
+#define CMD_READ_OCR           58
+#define ACMD_SD_SEND_OP_COND   41
+
+#define R1_IDLE        0x01
+#define TOKEN_DATA     0xFE
+#define DATA_ACCEPTED  0x05
+
+// How long the card may take, as the SD specification allows
+#define READ_TIMEOUT_MS  100
+#define WRITE_TIMEOUT_MS 250
+#define INIT_TIMEOUT_MS  1000
+
+// Bytes clocked per millisecond at full speed, F_CPU/2. Polling takes time of
+// its own too, so waits counted in bytes last at least as long as meant.
+#define SPI_BYTES_PER_MS (F_CPU / 16 / 1000)
+
+// Tries at leaving the idle state, each of at least 16 bytes at F_CPU/32
+#define INIT_TRIES (INIT_TIMEOUT_MS * (F_CPU / 1000) / (16 * 8 * 32))
+
+// SDHC and later cards are addressed by sector, older ones by byte
+static uint8_t highCapacity;
+
+// The transfer is over after 8 clocks of SCK, whatever the card does
+static uint8_t spi(uint8_t out) {
+    SPDR = out;
+    while (!(SPSR & _BV(SPIF)));
+    return SPDR;
+}
+
+// Clock bytes in until the card sends one other than <idle>, for at most <ms>
+// milliseconds. Returns that byte, or <idle> if the card took too long.
+static uint8_t waitWhile(uint8_t idle, uint16_t ms) {
+    uint8_t in = idle;
+
+    for (uint32_t tries = (uint32_t) ms * SPI_BYTES_PER_MS; tries > 0 && in == idle; tries--)
+        in = spi(0xFF);
+
+    return in;
+}
+
+static void select() {
+    PORTB &= ~_BV(SD_CS);
+}
+
+static void deselect() {
+    PORTB |= _BV(SD_CS);
+    spi(0xFF);
+}
+
+// Send a command and return its R1 response, 0xFF if there was none
+static uint8_t command(uint8_t cmd, uint32_t arg) {
+    spi(0xFF);
+    spi(0x40 | cmd);
+    spi(arg >> 24);
+    spi(arg >> 16);
+    spi(arg >> 8);
+    spi(arg);
+
+    // Only the first two commands are sent before CRCs are switched off
+    spi(cmd == CMD_GO_IDLE_STATE ? 0x95 : cmd == CMD_SEND_IF_COND ? 0x87 : 0x01);
+
+    for (uint8_t i = 0; i < 10; i++) {
+        uint8_t r1 = spi(0xFF);
+        if (!(r1 & 0x80))
+            return r1;
+    }
+
+    return 0xFF;
+}
+
+uint8_t sdCardPresent() {
+    DDRB &= ~_BV(SD_CD);
+    PORTB |= _BV(SD_CD);
+
+    return !(PINB & _BV(SD_CD));
+}
+
+result sdCardInit() {
+    if (!sdCardPresent())
+        return NOT_MOUNTED;
+
+    DDRB |= _BV(SD_CS) | _BV(SD_SCK) | _BV(SD_MOSI);
+    DDRB &= ~_BV(SD_MISO);
+    PORTB |= _BV(SD_CS);
+
+    // Cards start up at no more than 400kHz: F_CPU/32
+    SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR1);
+    SPSR = _BV(SPI2X);
+
+    // At least 74 clocks with the card deselected
+    for (uint8_t i = 0; i < 10; i++)
+        spi(0xFF);
+
+    select();
+
+    result r = UNDEFINED_ERROR;
+
+    if (command(CMD_GO_IDLE_STATE, 0) != R1_IDLE) {
+        deselect();
+        return r;
+    }
+
+    // Version 2 cards echo the check pattern back
+    uint8_t version2 = 0;
+    if (command(CMD_SEND_IF_COND, 0x1AA) == R1_IDLE) {
+        uint8_t r7[4];
+        for (uint8_t i = 0; i < 4; i++)
+            r7[i] = spi(0xFF);
+
+        version2 = r7[3] == 0xAA;
+    }
+
+    // Wait for the card to leave the idle state
+    uint8_t r1 = R1_IDLE;
+    for (uint16_t tries = 0; tries < INIT_TRIES && r1 != 0; tries++) {
+        command(CMD_APP_CMD, 0);
+        r1 = command(ACMD_SD_SEND_OP_COND, version2 ? 0x40000000 : 0);
+    }
+
+    highCapacity = 0;
+
+    if (r1 == 0) {
+        r = NO_ERROR;
+
+        if (version2 && command(CMD_READ_OCR, 0) == 0) {
+            uint8_t ocr[4];
+            for (uint8_t i = 0; i < 4; i++)
+                ocr[i] = spi(0xFF);
+
+            highCapacity = (ocr[0] & 0x40) != 0;
+        }
+
+        if (!highCapacity && command(CMD_SET_BLOCKLEN, SD_SECTOR_SIZE) != 0)
+            r = UNDEFINED_ERROR;
+    }
+
+    deselect();
+
+    // Full speed from here on: F_CPU/2
+    SPCR = _BV(SPE) | _BV(MSTR);
+    SPSR = _BV(SPI2X);
+
+    return r;
+}
+
+result sdReadSector(uint32_t sector, uint8_t* buf) {
+    select();
+
+    if (command(CMD_READ_SINGLE_BLOCK, highCapacity ? sector : sector * SD_SECTOR_SIZE) != 0) {
+        deselect();
+        return UNDEFINED_ERROR;
+    }
+
+    if (waitWhile(0xFF, READ_TIMEOUT_MS) != TOKEN_DATA) {
+        deselect();
+        return UNDEFINED_ERROR;
+    }
+
+    for (uint16_t i = 0; i < SD_SECTOR_SIZE; i++)
+        buf[i] = spi(0xFF);
+
+    // CRC
+    spi(0xFF);
+    spi(0xFF);
+
+    deselect();
+    return NO_ERROR;
+}
+
+result sdWriteSector(uint32_t sector, const uint8_t* buf) {
+    select();
+
+    if (command(CMD_WRITE_BLOCK, highCapacity ? sector : sector * SD_SECTOR_SIZE) != 0) {
+        deselect();
+        return UNDEFINED_ERROR;
+    }
+
+    spi(TOKEN_DATA);
+
+    for (uint16_t i = 0; i < SD_SECTOR_SIZE; i++)
+        spi(buf[i]);
+
+    // CRC, ignored
+    spi(0xFF);
+    spi(0xFF);
+
+    if ((spi(0xFF) & 0x1F) != DATA_ACCEPTED) {
+        deselect();
+        return UNDEFINED_ERROR;
+    }
+
+    // The card holds the line low while it programs the sector
+    result r = waitWhile(0x00, WRITE_TIMEOUT_MS) != 0x00 ? NO_ERROR : UNDEFINED_ERROR;
+
+    deselect();
+    return r;
+}
+
+#endif
@@ -0,0 +1,33 @@
+/**
+* SD card access for OSFS, a sector at a time
+*
+* On the AVR the card is driven over SPI, and is there when the card detect
+* switch on PB6 (OS_CD in input.h) is closed. Host builds use a disk image
+* file in its place.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "OSFS.h"
+
+#define SD_SECTOR_SIZE 512
+
+// Whether there is a card in the slot
+uint8_t sdCardPresent();
+
+// Bring up the card. NOT_MOUNTED if there is none, UNDEFINED_ERROR if it does
+// not answer.
+result sdCardInit();
+
+// UNDEFINED_ERROR if the card refuses the sector or does not answer in the
+// time the SD specification allows
+result sdReadSector(uint32_t sector, uint8_t* buf);
+result sdWriteSector(uint32_t sector, const uint8_t* buf);
+
+#ifndef __AVR__
+
+// The disk image standing in for the card, NULL for an empty slot
+void sdCardImage(const char* path);
+
+#endif
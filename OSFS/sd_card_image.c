@@ -0,0 +1,57 @@
+/**
+* SD card access for OSFS, against a disk image file in host builds
+*/
+
+#include "sd_card.h"
+
+#ifndef __AVR__
+
+#include <stdio.h>
+
+static const char* imagePath;
+static FILE* image;
+
+void sdCardImage(const char* path) {
+    if (image != NULL)
+        fclose(image);
+
+    image = NULL;
+    imagePath = path;
+}
+
+uint8_t sdCardPresent() {
+    return imagePath != NULL;
+}
+
+result sdCardInit() {
+    if (!sdCardPresent())
+        return NOT_MOUNTED;
+
+    if (image == NULL)
+        image = fopen(imagePath, "r+b");
+
+    return image != NULL ? NO_ERROR : UNDEFINED_ERROR;
+}
+
+result sdReadSector(uint32_t sector, uint8_t* buf) {
+    if (image == NULL || fseek(image, (long) sector * SD_SECTOR_SIZE, SEEK_SET) != 0)
+        return UNDEFINED_ERROR;
+
+    // Past the end of the image reads like erased flash
+    size_t read = fread(buf, 1, SD_SECTOR_SIZE, image);
+    memset(buf + read, 0xFF, SD_SECTOR_SIZE - read);
+
+    return NO_ERROR;
+}
+
+result sdWriteSector(uint32_t sector, const uint8_t* buf) {
+    if (image == NULL || fseek(image, (long) sector * SD_SECTOR_SIZE, SEEK_SET) != 0)
+        return UNDEFINED_ERROR;
+
+    if (fwrite(buf, 1, SD_SECTOR_SIZE, image) != SD_SECTOR_SIZE || fflush(image) != 0)
+        return UNDEFINED_ERROR;
+
+    return NO_ERROR;
+}
+
+#endif
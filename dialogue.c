@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <avr/pgmspace.h>
+#include "dialogue.h"
+#include "dialogue_packed.h"
+#include "OSFS_backends.h"
+#include "sd_card.h"
+
+osfsVolume dialogue_volume;
+
+static osfsBackend card_backend;
+static osfsBackend flash_backend;
+
+/*
+ * The whole OSFS volume, from its address 0. Each file is followed by the
+ * next one, and the last by an empty file marking where new files go. Files
+ * hold their packed text without the terminating null character.
+ */
+#define IMAGE_FIELD(field, file_id, line) \
+    struct { fileHeader header; char text[sizeof(line) - 1]; } field;
+
+typedef struct dialogue_image {
+    uint8_t reserved;  /* below startOfEEPROM */
+    FSInfo info;
+    DIALOGUE_PACKED(IMAGE_FIELD)
+    fileHeader end;
+} dialogue_image;
+
+#define IMAGE_FILE(field, file_id, line) \
+    .field = {{file_id, sizeof(line) - 1, \
+               offsetof(dialogue_image, field) + sizeof(((dialogue_image*) 0)->field), 0}, line},
+
+#define DIALOGUE_IMAGE { \
+    .reserved = 0xFF, \
+    .info = {OSFS_ID_STR, OSFS_VER}, \
+    DIALOGUE_PACKED(IMAGE_FILE) \
+    .end = {OSFS_NO_ID, 0, 0, 0} \
+}
+
+/* Read in place from flash, through a read-only backend. */
+static const dialogue_image dialogue_flash PROGMEM = DIALOGUE_IMAGE;
+
+uint8_t dialogue_busy() {
+    return sdBusy();
+}
+
+result mount_dialogue() {
+    /* A card that does not hold a volume is left alone. */
+    if (sdCardPresent()
+        && sdBackend(&card_backend, DIALOGUE_CARD_SECTOR, DIALOGUE_CARD_SIZE) == NO_ERROR) {
+        useBackend(&card_backend);
+
+        if (mount(&dialogue_volume) == NO_ERROR)
+            return NO_ERROR;
+    }
+
+    progmemBackend(&flash_backend, pgm_get_far_address(dialogue_flash), sizeof(dialogue_image));
+    useBackend(&flash_backend);
+
+    return mount(&dialogue_volume);
+}
@@ -0,0 +1,101 @@
+#ifndef DIALOGUE_H
+#define DIALOGUE_H
+
+#include "OSFS.h"
+
+/*
+ * Buffer size for a line of dialogue, null character included. The build
+ * fails if a line in DIALOGUE_FILES does not fit.
+ */
+#define MAX_LINE_SIZE 96
+
+/* Interactions, numbered as they are in interactions[]. */
+enum {
+    DIALOGUE_GUARD,
+    DIALOGUE_BODY,
+    DIALOGUE_UP,
+    DIALOGUE_DOWN,
+    DIALOGUE_BOX,
+    DIALOGUE_CAT
+};
+
+/* Kinds of line; none is 0, so that no ID is either. */
+#define LINE_GREET  1
+#define LINE_PLAYER 2
+#define LINE_WORLD  3
+
+/*
+ * The OSFS file ID of a line: the interaction in the high byte, and the
+ * option and kind of line packed into the low one.
+ */
+#define DIALOGUE_ID(interaction, option, kind) \
+    ((uint16_t) ((interaction) << 8 | (option) << 2 | (kind)))
+#define DIALOGUE_GREET(interaction) DIALOGUE_ID(interaction, 0, LINE_GREET)
+
+/*
+ * All of the dialogue, one OSFS file per line: X(identifier, file ID, text).
+ * It is never written to during play; lines that only show later in the game
+ * are picked by the conditions of their options (see interaction.c).
+ *
+ * tools/pack_dialogue.py compresses these into dialogue_packed.h, which the
+ * build lays out into a ready-made OSFS volume in flash. Files are read back
+ * through text_reader.h.
+ */
+#define DIALOGUE_FILES(X) \
+    X(guard_g,  DIALOGUE_GREET(DIALOGUE_GUARD),              "Evening officer!") \
+    X(guard_0p, DIALOGUE_ID(DIALOGUE_GUARD, 0, LINE_PLAYER), "What's going on?") \
+    X(guard_0w, DIALOGUE_ID(DIALOGUE_GUARD, 0, LINE_WORLD),  "The master was found lying dead, officer.") \
+    X(guard_1p, DIALOGUE_ID(DIALOGUE_GUARD, 1, LINE_PLAYER), "Who are you?") \
+    X(guard_1w, DIALOGUE_ID(DIALOGUE_GUARD, 1, LINE_WORLD),  "I've been hired to do guard the property.") \
+    X(guard_2p, DIALOGUE_ID(DIALOGUE_GUARD, 2, LINE_PLAYER), "Noticed anything suspicious?") \
+    X(guard_2w, DIALOGUE_ID(DIALOGUE_GUARD, 2, LINE_WORLD),  "I just heard the cat meow lowdly at some point. It was scary...") \
+    X(guard_3p, DIALOGUE_ID(DIALOGUE_GUARD, 3, LINE_PLAYER), "Where does the door upstairs lead to?") \
+    X(guard_3w, DIALOGUE_ID(DIALOGUE_GUARD, 3, LINE_WORLD),  "The master's bathroom, but I don't have the key. Be careful though! The cat is in there.") \
+    X(body_g,   DIALOGUE_GREET(DIALOGUE_BODY),               "The master lies dead on the floor in a cold puddle of blood.") \
+    X(body_0p,  DIALOGUE_ID(DIALOGUE_BODY, 0, LINE_PLAYER),  "Search the body.") \
+    X(body_0w,  DIALOGUE_ID(DIALOGUE_BODY, 0, LINE_WORLD),   "You find a key in one of the pockets.") \
+    X(body_1p,  DIALOGUE_ID(DIALOGUE_BODY, 1, LINE_PLAYER),  "Search the body.") \
+    X(body_1w,  DIALOGUE_ID(DIALOGUE_BODY, 1, LINE_WORLD),   "You find nothing.") \
+    X(up_g,     DIALOGUE_GREET(DIALOGUE_UP),                 "A wodden staircase.") \
+    X(up_0p,    DIALOGUE_ID(DIALOGUE_UP, 0, LINE_PLAYER),    "Go upstairs.") \
+    X(up_0w,    DIALOGUE_ID(DIALOGUE_UP, 0, LINE_WORLD),     "You climb the shoddy stairs.") \
+    X(down_g,   DIALOGUE_GREET(DIALOGUE_DOWN),               "A wodden staircase.") \
+    X(down_0p,  DIALOGUE_ID(DIALOGUE_DOWN, 0, LINE_PLAYER),  "Go downstairs.") \
+    X(down_0w,  DIALOGUE_ID(DIALOGUE_DOWN, 0, LINE_WORLD),   "The wood squeaks under your weight. You are now downstairs.") \
+    X(box_g,    DIALOGUE_GREET(DIALOGUE_BOX),                "The cat's litter box.") \
+    X(box_0p,   DIALOGUE_ID(DIALOGUE_BOX, 0, LINE_PLAYER),   "Inspect.") \
+    X(box_0w,   DIALOGUE_ID(DIALOGUE_BOX, 0, LINE_WORLD),    "You find a bloddy knife covered by the litter and large amounts of catnip.") \
+    X(cat_g,    DIALOGUE_GREET(DIALOGUE_CAT),                "An innocent looking cat. \"Meow!\"") \
+    X(cat_0p,   DIALOGUE_ID(DIALOGUE_CAT, 0, LINE_PLAYER),   "Pet the cat.") \
+    X(cat_0w,   DIALOGUE_ID(DIALOGUE_CAT, 0, LINE_WORLD),    "Meow, Meow.") \
+    X(cat_1p,   DIALOGUE_ID(DIALOGUE_CAT, 1, LINE_PLAYER),   "Are you high?") \
+    X(cat_1w,   DIALOGUE_ID(DIALOGUE_CAT, 1, LINE_WORLD),    "Meowbe.") \
+    X(cat_2p,   DIALOGUE_ID(DIALOGUE_CAT, 2, LINE_PLAYER),   "You are under arrest for capital murder!") \
+    X(cat_2w,   DIALOGUE_ID(DIALOGUE_CAT, 2, LINE_WORLD),    "Meow...")
+
+/*
+ * Dialogue can also come from a content pack on an SD card: an OSFS volume
+ * of up to 64KB written raw to the card from this sector on. It lies in the
+ * gap partitioning tools leave before a first partition aligned to 1MB,
+ * clear of the MBR or GPT, and is only used if it starts with the OSFS
+ * signature. "make host-sd" builds a card image with one.
+ */
+#define DIALOGUE_CARD_SECTOR 1024
+#define DIALOGUE_CARD_SIZE   0xFFFF
+
+/* The volume the dialogue is stored on, mounted by mount_dialogue(). */
+extern osfsVolume dialogue_volume;
+
+/*
+ * Mount the content pack on the SD card if there is one, and otherwise the
+ * dialogue built into the firmware.
+ */
+result mount_dialogue();
+
+/*
+ * Whether a task is reading the dialogue off the SD card. A task preempting
+ * it would get BUSY for every line, so it should leave its work for later.
+ */
+uint8_t dialogue_busy();
+
+#endif /* DIALOGUE_H */
@@ -0,0 +1,62 @@
+/* Generated by tools/pack_dialogue.py from dialogue.h; do not edit. */
+
+#ifndef DIALOGUE_PACKED_H
+#define DIALOGUE_PACKED_H
+
+/* 864 bytes of text packed into 360. */
+
+#define DIALOGUE_PAIR_COUNT 121
+#define DIALOGUE_PAIR_DEPTH 8
+
+#define DIALOGUE_PAIRS { \
+    {101, 32}, {104, 128}, {105, 110}, {101, 114}, {100, 32}, {111, 117}, {115, 116}, {115, 32}, \
+    {97, 114}, {116, 129}, {111, 119}, {97, 116}, {105, 114}, {134, 97}, {141, 140}, {32, 137}, \
+    {111, 100}, {133, 32}, {130, 103}, {84, 129}, {131, 32}, {99, 139}, {101, 138}, {89, 145}, \
+    {101, 110}, {146, 32}, {111, 102}, {111, 32}, {121, 46}, {111, 111}, {115, 46}, {77, 150}, \
+    {105, 99}, {111, 110}, {101, 97}, {116, 104}, {121, 32}, {116, 32}, {114, 32}, {101, 46}, \
+    {108, 105}, {144, 100}, {142, 158}, {87, 104}, {39, 135}, {147, 109}, {173, 97}, {174, 134}, \
+    {44, 32}, {136, 128}, {152, 32}, {101, 132}, {101, 136}, {116, 46}, {107, 101}, {103, 104}, \
+    {130, 32}, {97, 32}, {151, 102}, {186, 130}, {187, 132}, {99, 97}, {154, 102}, {190, 160}, \
+    {191, 131}, {175, 148}, {119, 97}, {194, 135}, {133, 110}, {132, 108}, {100, 162}, {121, 133}, \
+    {118, 128}, {155, 100}, {132, 137}, {97, 110}, {115, 112}, {73, 32}, {134, 32}, {149, 32}, \
+    {100, 108}, {112, 111}, {181, 32}, {99, 136}, {46, 46}, {101, 135}, {157, 166}, {117, 112}, \
+    {108, 32}, {99, 111}, {128, 154}, {98, 108}, {83, 180}, {220, 99}, {221, 104}, {222, 143}, \
+    {223, 98}, {224, 144}, {188, 185}, {110, 111}, {65, 32}, {228, 119}, {229, 169}, {230, 178}, \
+    {231, 142}, {232, 189}, {233, 115}, {234, 167}, {169, 164}, {138, 110}, {237, 170}, {117, 110}, \
+    {239, 100}, {240, 148}, {105, 183}, {151, 177}, {168, 116}, {244, 116}, {245, 148}, {110, 105}, \
+    {149, 46}, \
+}
+
+#define DIALOGUE_PACKED(X) \
+    X(guard_g,  DIALOGUE_GREET(DIALOGUE_GUARD),              "Ev\230\231\300!") \
+    X(guard_0p, DIALOGUE_ID(DIALOGUE_GUARD, 0, LINE_PLAYER), "\253\213\254go\231\241\?") \
+    X(guard_0w, DIALOGUE_ID(DIALOGUE_GUARD, 0, LINE_WORLD),  "\301\303f\304\305y\231\306d\260\300.") \
+    X(guard_1p, DIALOGUE_ID(DIALOGUE_GUARD, 1, LINE_PLAYER), "\253\233\261\307\?") \
+    X(guard_1w, DIALOGUE_ID(DIALOGUE_GUARD, 1, LINE_WORLD),  "I'\310be\262h\214\263t\311\233gu\210\312prop\203t\234") \
+    X(guard_2p, DIALOGUE_ID(DIALOGUE_GUARD, 2, LINE_PLAYER), "Not\240\263\313y\243\231su\314\240i\205s\?") \
+    X(guard_2w, DIALOGUE_ID(DIALOGUE_GUARD, 2, LINE_WORLD),  "\315ju\316h\264\312\317m\226 l\212\320\244\213 som\200\321\202\322I\245\303s\323\234\324") \
+    X(guard_3p, DIALOGUE_ID(DIALOGUE_GUARD, 3, LINE_PLAYER), "\253\203\200do\325\211d\326\327\216\207l\242\204to\?") \
+    X(guard_3w, DIALOGUE_ID(DIALOGUE_GUARD, 3, LINE_WORLD),  "\257\203\254b\213hr\235m\260bu\245\315d\241'\245ha\310\211\266\234 B\200\323efu\330\243\205\267! \223\317i\207\270\243\203\247") \
+    X(body_g,   DIALOGUE_GREET(DIALOGUE_BODY),               "\301\250\325\306\204\241\217fl\326\270\271\331l\204pud\320\332 \333o\220.") \
+    X(body_0p,  DIALOGUE_ID(DIALOGUE_BODY, 0, LINE_PLAYER),  "\341\234") \
+    X(body_0w,  DIALOGUE_ID(DIALOGUE_BODY, 0, LINE_WORLD),   "\342\266\244\270\241\332\217\321c\266t\236") \
+    X(body_1p,  DIALOGUE_ID(DIALOGUE_BODY, 1, LINE_PLAYER),  "\341\234") \
+    X(body_1w,  DIALOGUE_ID(DIALOGUE_BODY, 1, LINE_WORLD),   "\274\343\243\222.") \
+    X(up_g,     DIALOGUE_GREET(DIALOGUE_UP),                 "\353") \
+    X(up_0p,    DIALOGUE_ID(DIALOGUE_UP, 0, LINE_PLAYER),    "G\233\327\252") \
+    X(up_0w,    DIALOGUE_ID(DIALOGUE_UP, 0, LINE_WORLD),     "\227c\250mb\217sh\354\252") \
+    X(down_g,   DIALOGUE_GREET(DIALOGUE_DOWN),               "\353") \
+    X(down_0p,  DIALOGUE_ID(DIALOGUE_DOWN, 0, LINE_PLAYER),  "G\311\356") \
+    X(down_0w,  DIALOGUE_ID(DIALOGUE_DOWN, 0, LINE_WORLD),   "\223w\235\204squ\242k\207\361\307\246we\362\322\363n\212 d\356") \
+    X(box_g,    DIALOGUE_GREET(DIALOGUE_BOX),                "\223\225\254\366box.") \
+    X(box_0p,   DIALOGUE_ID(DIALOGUE_BOX, 0, LINE_PLAYER),   "In\314ec\265") \
+    X(box_0w,   DIALOGUE_ID(DIALOGUE_BOX, 0, LINE_WORLD),    "\342\333\354k\367f\200\331v\203\263by\217\366\313\305\210g\200am\304t\207\232 \225\367p.") \
+    X(cat_g,    DIALOGUE_GREET(DIALOGUE_CAT),                "An \202\343c\230\245l\235k\231\370 \"\237!\"") \
+    X(cat_0p,   DIALOGUE_ID(DIALOGUE_CAT, 0, LINE_PLAYER),   "Pet\217\370") \
+    X(cat_0w,   DIALOGUE_ID(DIALOGUE_CAT, 0, LINE_WORLD),    "\237\260\237.") \
+    X(cat_1p,   DIALOGUE_ID(DIALOGUE_CAT, 1, LINE_PLAYER),   "Ar\200y\221h\362\?") \
+    X(cat_1w,   DIALOGUE_ID(DIALOGUE_CAT, 1, LINE_WORLD),    "\237b\247") \
+    X(cat_2p,   DIALOGUE_ID(DIALOGUE_CAT, 2, LINE_PLAYER),   "\363\361\210re\316fo\246\275pita\330murd\203!") \
+    X(cat_2w,   DIALOGUE_ID(DIALOGUE_CAT, 2, LINE_WORLD),    "\237\324.")
+
+#endif /* DIALOGUE_PACKED_H */
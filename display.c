@@ -1,8 +1,82 @@
 #include "display.h"
+#include <avr/interrupt.h>
 
-uint16_t text_box_y = 0;
+/*
+ * What is currently on screen for each cell of the map view. Only the cells
+ * that differ from it get repainted; a zero entry forces a repaint.
+ */
+static char shown_map[GAME_MAP_VIEW_H][GAME_MAP_VIEW_W];
+static size_t shown_z = MAX_Z + 1;
 
-void write_line_to_text_box(const char* text, uint16_t col);
+/*
+ * The dialogue log: the last TEXT_BOX_LOG_LINES lines written to the text
+ * box, already broken up to fit. Line n is kept in log_lines[n % size].
+ */
+typedef struct log_line {
+    char text[TEXT_BOX_LINE_LENGTH];
+    uint8_t length;
+    uint16_t col;
+} log_line;
+
+static log_line log_lines[TEXT_BOX_LOG_LINES];
+static uint16_t log_count = 0;
+static uint8_t log_scroll = 0;
+
+/*
+ * The options shown under the log, and the row each of them starts on, so
+ * that moving the selection only recolours two of them. The entry after the
+ * last option holds the row the options end on. Options that do not all fit
+ * are scrolled through from first_option; those off screen start and end on
+ * the same row.
+ */
+static interaction* shown_interaction = NULL;
+static uint8_t shown_mask = 0;
+static uint8_t shown_size = 0;
+static uint8_t shown_selected = NONE_SELECTED;
+static uint8_t options_drawn = 0;
+static uint8_t option_row[MAX_OPTIONS + 1] = {TEXT_BOX_ROWS};
+static uint8_t first_option = 0;
+
+/* Options are numbered in a column of their own, left of their first line. */
+#define OPTION_NUMBER_LENGTH 3
+
+#if TEXT_BOX_LINE_LENGTH > LAYOUT_MAX_WIDTH
+#error "Lines of the text box are too long to be streamed"
+#endif
+
+/*
+ * The text of each option shown, streamed from storage and laid out once when
+ * the options change. Its lines are kept one after the other, without the
+ * spaces they were broken at, so that drawing and recolouring it neither goes
+ * back to storage nor lays it out again.
+ */
+typedef struct option_text {
+    char text[MAX_LINE_SIZE];
+    text_layout layout;
+} option_text;
+
+static option_text option_texts[MAX_OPTIONS];
+
+/* An option being streamed, or the error met opening it. */
+typedef struct option_source {
+    text_reader reader;
+    const char* error;
+} option_source;
+
+/*
+ * What each row of the text box shows: the number of the log line on it plus
+ * one, BLANK_ROW, or 0 if it has to be redrawn.
+ */
+#define BLANK_ROW 0xFFFF
+static uint16_t shown_rows[TEXT_BOX_ROWS];
+
+uint8_t camera_origin(uint8_t player, uint8_t min, uint8_t max, uint8_t view);
+rectangle text_box_row(uint8_t row);
+void lay_out_option(option_text* option, uint8_t index);
+uint8_t option_lines(uint8_t index);
+void place_options(uint8_t selected_index);
+uint8_t option_line_width(uint8_t line);
+uint8_t draw_option(uint8_t index, uint16_t col, uint8_t recolour);
 
 void initialize_display() {
     /* 8MHz clock, no prescaling (DS, p. 48) */
@@ -10,100 +84,414 @@ void initialize_display() {
     CLKPR = 0;
 
     init_lcd();
+
+    /* init_lcd() leaves the screen cleared. */
+    for (uint8_t row = 0; row < TEXT_BOX_ROWS; ++row)
+        shown_rows[row] = BLANK_ROW;
 }
 
-void draw_game_map(game_map* map) {
-    // If the map cannot fit on the display it does not get drawn.
-    if (MAX_X * (FONT_WIDTH + GAME_MAP_X_GAP) > GAME_MAP_X_MAX
-        || MAX_Y * (FONT_HEIGHT + GAME_MAP_Y_GAP) > GAME_MAP_Y_MAX)
-        return;
+/*
+ * First map coordinate shown along one axis. The camera is centred on the
+ * player and stopped at the edges of the map; maps that fit are not scrolled.
+ */
+uint8_t camera_origin(uint8_t player, uint8_t min, uint8_t max, uint8_t view) {
+    if (max - min + 1 <= view || player < min + view / 2)
+        return min;
+
+    if (player + (view - view / 2) > max + 1)
+        return max + 1 - view;
 
+    return player - view / 2;
+}
+
+uint8_t draw_game_map(game_map* map) {
     size_t z = map->player.z;
+    uint8_t drawn = 1;
+
+    /* A different floor shares almost nothing with the one on screen. */
+    if (z != shown_z) {
+        invalidate_game_map();
+        shown_z = z;
+    }
+
+    uint8_t camera_x = camera_origin(map->player.x, MIN_X, MAX_X, GAME_MAP_VIEW_W);
+    uint8_t camera_y = camera_origin(map->player.y, MIN_Y, MAX_Y, GAME_MAP_VIEW_H);
+
+    /*
+     * Moving the camera only repaints the cells whose tile changed, which
+     * on the mostly uniform floors of the mansion is a fraction of the view.
+     */
+    for (uint8_t row = 0; row < GAME_MAP_VIEW_H; ++row)
+        for (uint8_t col = 0; col < GAME_MAP_VIEW_W; ++col) {
+            size_t x = camera_x + col;
+            size_t y = camera_y + row;
+
+            char to_display;
+            if (x > MAX_X || y > MAX_Y)
+                to_display = ' ';
+            else if (map->player.x == x && map->player.y == y)
+                to_display = '@';
+            else
+                to_display = map->matrix[z][y][x];
 
-    for (size_t y = MIN_Y; y <= MAX_Y; ++y)
-        for (size_t x = MIN_X; x <= MAX_X; ++x) {
-            char to_display = map->player.x == x && map->player.y == y ?
-                              '@' : map->matrix[z][y][x];
+            if (shown_map[row][col] == to_display)
+                continue;
 
-            uint16_t x_display = x * (FONT_WIDTH + GAME_MAP_X_GAP);
-            uint16_t y_display = y * (FONT_HEIGHT + GAME_MAP_Y_GAP);
+            uint16_t x_display = GAME_MAP_X_MIN + col * GAME_MAP_CELL_WIDTH;
+            uint16_t y_display = GAME_MAP_Y_MIN + row * GAME_MAP_CELL_HEIGHT;
 
-            display_char_xy(to_display, x_display, y_display, WHITE);
+            /*
+             * Glyphs are taller than a map row. Clip them to the row so that
+             * repainting a cell does not wipe the top of the one below it.
+             */
+            rectangle r;
+            r.left = x_display;
+            r.right = x_display + FONT_HEIGHT - 1;
+            r.top = y_display;
+            r.bottom = y_display + GAME_MAP_CELL_HEIGHT - 1;
+
+            /* Cells left out of a full queue still differ next time. */
+            if (queue_text_run(&to_display, 1, r, WHITE, BLACK))
+                shown_map[row][col] = to_display;
+            else
+                drawn = 0;
         }
+
+    return drawn;
+}
+
+void invalidate_game_map() {
+    memset(shown_map, 0, sizeof(shown_map));
 }
 
-void clear_game_map() {
+uint8_t clear_game_map() {
     rectangle r;
     r.left = GAME_MAP_X_MIN;
     r.right = GAME_MAP_X_MAX;
     r.top = GAME_MAP_Y_MIN;
     r.bottom = GAME_MAP_Y_MAX;
 
-    fill_rectangle(r, BLACK);
+    if (!queue_fill(r, BLACK))
+        return 0;
+
+    invalidate_game_map();
+    return 1;
+}
+
+/*
+ * Rows are only drawn down to the next one, so that redrawing a row leaves
+ * the top of the one below it intact. The last row of the box gets the whole
+ * height of the glyphs.
+ */
+rectangle text_box_row(uint8_t row) {
+    rectangle r;
+    r.left = TEXT_BOX_X_MIN;
+    r.right = TEXT_BOX_X_MAX - 1;
+    r.top = TEXT_BOX_Y_MIN + row * TEXT_BOX_LINE_PITCH;
+    r.bottom = r.top - 1
+               + (row == TEXT_BOX_ROWS - 1 ? FONT_WIDTH : TEXT_BOX_LINE_PITCH);
+
+    return r;
 }
 
-void write_to_text_box(const char* text, uint16_t col) {
-    size_t length = strlen(text);
+/* Text longer than one layout is laid out again from where that one ended. */
+void log_to_text_box(const char* text, uint16_t col) {
+    text_layout layout;
+    uint8_t overflow;
 
-    /* Break the string up into lines that can fit. */
-    for (size_t i = 0; i < length; i += TEXT_BOX_LINE_LENGTH) {
-        size_t line_length = TEXT_BOX_LINE_LENGTH > (length - i + 1)
-                             ? (length - i + 1) : TEXT_BOX_LINE_LENGTH;
-        char line[TEXT_BOX_LINE_LENGTH];
-        strncpy(line, text + i, line_length);
+    do {
+        overflow = layout_text(text, TEXT_BOX_LINE_LENGTH, &layout);
 
-        write_line_to_text_box(line, col);
-    }
+        for (uint8_t i = 0; i < layout.size; ++i) {
+            log_line* line = &log_lines[log_count % TEXT_BOX_LOG_LINES];
+
+            line->length = layout.lines[i].length;
+            memcpy(line->text, text + layout.lines[i].start, line->length);
+            line->col = col;
+
+            /* The text box is drawn from another task. */
+            cli();
+            log_count++;
+            log_scroll = 0;
+            sei();
+        }
+
+        if (overflow) {
+            span last = layout.lines[layout.size - 1];
+            text += last.start + last.length;
+        }
+    } while (overflow);
 }
 
-void write_line_to_text_box(const char* text, uint16_t col) {
-    display_string_xy(text, TEXT_BOX_X_MIN, text_box_y, col);
-    text_box_y += FONT_HEIGHT + 5;
+void scroll_text_box(int8_t lines) {
+    uint8_t log_rows = option_row[0];
+    uint16_t kept = log_count < TEXT_BOX_LOG_LINES
+                    ? log_count : TEXT_BOX_LOG_LINES;
+    int16_t max_scroll = kept > log_rows ? kept - log_rows : 0;
+
+    /* Turning the wheel back goes back through older lines. */
+    int16_t scroll = (int16_t) log_scroll - lines;
+
+    if (scroll < 0)
+        scroll = 0;
+    if (scroll > max_scroll)
+        scroll = max_scroll;
+
+    log_scroll = scroll;
 }
 
-void clear_text_box() {
+uint8_t clear_text_box() {
     rectangle r;
     r.left = TEXT_BOX_X_MIN;
     r.right = TEXT_BOX_X_MAX;
     r.top = TEXT_BOX_Y_MIN;
     r.bottom = TEXT_BOX_Y_MAX;
 
-    fill_rectangle(r, BLACK);
-    text_box_y = 0;
+    if (!queue_fill(r, BLACK))
+        return 0;
+
+    for (uint8_t row = 0; row < TEXT_BOX_ROWS; ++row)
+        shown_rows[row] = BLANK_ROW;
+    options_drawn = 0;
+    return 1;
+}
+
+void set_text_box_options(interaction* current_interaction,
+        uint8_t selected_index) {
+    uint8_t mask = current_interaction == NULL
+                   ? 0 : shown_options(current_interaction);
+    uint8_t size = count_options(mask);
+
+    if (current_interaction == shown_interaction && mask == shown_mask) {
+        select_interaction_option(current_interaction, selected_index);
+        return;
+    }
+
+    shown_interaction = current_interaction;
+    shown_mask = mask;
+    shown_size = size;
+    shown_selected = selected_index;
+    options_drawn = 0;
+    first_option = 0;
+
+    for (uint8_t i = 0; i < size; ++i)
+        lay_out_option(&option_texts[i], i);
+
+    place_options(selected_index);
+}
+
+/* The number takes a row even if there is no text. */
+uint8_t option_lines(uint8_t index) {
+    uint8_t lines = option_texts[index].layout.size;
+    return lines != 0 ? lines : 1;
+}
+
+/*
+ * The options sit at the bottom of the box, under the log. If they do not
+ * all fit, the box shows as many as it can from first_option on, moved just
+ * far enough to keep the selected option on screen. No option is taller than
+ * the box, since none has more than LAYOUT_MAX_LINES lines.
+ */
+void place_options(uint8_t selected_index) {
+    uint8_t rows = 0;
+    uint8_t end = 0;
+
+    if (shown_size != 0) {
+        if (selected_index >= shown_size)
+            selected_index = 0;
+        if (selected_index < first_option)
+            first_option = selected_index;
+
+        for (uint8_t i = first_option; i <= selected_index; ++i)
+            rows += option_lines(i);
+
+        while (rows > TEXT_BOX_ROWS)
+            rows -= option_lines(first_option++);
+
+        end = selected_index + 1;
+        while (end < shown_size && rows + option_lines(end) <= TEXT_BOX_ROWS)
+            rows += option_lines(end++);
+    }
+
+    uint8_t row = TEXT_BOX_ROWS - rows;
+    for (uint8_t i = 0; i <= shown_size; ++i) {
+        option_row[i] = row;
+        if (i >= first_option && i < end)
+            row += option_lines(i);
+    }
 }
 
-void write_interaction(interaction* current_interaction,
-        const char* top_line, uint8_t selected_index, uint8_t show_options) {
-    if (current_interaction == NULL
-        || (selected_index >= current_interaction->size_options
-            && selected_index != NONE_SELECTED))
+#if LAYOUT_MAX_LINES > TEXT_BOX_ROWS
+#error "An option can be too tall for the text box"
+#endif
+
+void select_interaction_option(interaction* current_interaction,
+        uint8_t selected_index) {
+    if (current_interaction != shown_interaction
+        || selected_index == shown_selected)
         return;
 
-    if (selected_index != NONE_SELECTED)
-         current_interaction->showing = selected_index;
+    uint8_t previous_index = shown_selected;
+    shown_selected = selected_index;
 
-    strcpy(current_interaction->current_line, top_line);
-    write_to_text_box(top_line, WHITE);
+    /* Selecting an option scrolled off screen brings it back on. */
+    if (selected_index < shown_size
+        && option_row[selected_index] == option_row[selected_index + 1]) {
+        place_options(selected_index);
+        options_drawn = 0;
+    }
 
-    if (!show_options)
+    /* Options that are not on screen yet are drawn with the new selection. */
+    if (!options_drawn)
         return;
 
-    for (size_t i = 0; i < current_interaction->size_options; ++i) {
-        uint16_t col = i == selected_index ? YELLOW : WHITE;
+    uint8_t drawn = 1;
+
+    if (previous_index < shown_size)
+        drawn = draw_option(previous_index, WHITE, 1);
+
+    if (selected_index < shown_size && drawn)
+        drawn = draw_option(selected_index, YELLOW, 1);
+
+    /* Options that could not be recoloured are drawn again in full. */
+    if (!drawn)
+        options_drawn = 0;
+}
+
+static char next_option_char(void* source) {
+    option_source* option = source;
+
+    if (option->error == NULL)
+        return read_text_char(&option->reader);
+
+    return *option->error != '\0' ? *option->error++ : '\0';
+}
+
+/*
+ * Lines are copied out of the stream as they are laid out, so an option is
+ * never read whole into a buffer of its own first.
+ */
+void lay_out_option(option_text* option, uint8_t index) {
+    option_source source;
+    result r = open_player_line(&source.reader, shown_interaction,
+            shown_option(shown_mask, index));
+    source.error = r == NO_ERROR ? NULL : "ERROR";
+
+    line_stream lines;
+    open_line_stream(&lines, next_option_char, &source);
+
+    text_layout* layout = &option->layout;
+    uint8_t end = 0;
+    layout->size = 0;
+
+    while (layout->size < LAYOUT_MAX_LINES) {
+        uint8_t length = next_line(&lines, option_line_width(layout->size));
+        if (length == 0 || end + length > sizeof(option->text))
+            break;
+
+        memcpy(option->text + end, lines.text, length);
+        layout->lines[layout->size++] = (span) {end, length};
+        end += length;
+    }
+}
+
+uint8_t option_line_width(uint8_t line) {
+    return line == 0 ? TEXT_BOX_LINE_LENGTH - OPTION_NUMBER_LENGTH
+                     : TEXT_BOX_LINE_LENGTH;
+}
+
+static uint8_t queue_option_run(const char* text, uint8_t length, rectangle r,
+        uint16_t col, uint8_t recolour) {
+    if (recolour)
+        return queue_recolour(text, length, r, col, BLACK);
+    else
+        return queue_text_run(text, length, r, col, BLACK);
+}
 
-        /*
-         * Allocate a buffer large enough to fit the text.
-         * Note that we also need to take into account the
-         * number appended at the front.
-         */
-        char line[MAX_LINE_SIZE];
-        get_player_line(line, current_interaction, i);
-        size_t buffer_size = strlen(line) + 4;
-        char* to_write = malloc(buffer_size * sizeof(char));
+/*
+ * Lines go to the LCD queue straight from the laid out text, with the number
+ * of the option in a run of its own. Returns 0 if the queue filled up.
+ */
+uint8_t draw_option(uint8_t index, uint16_t col, uint8_t recolour) {
+    const option_text* option = &option_texts[index];
 
-        snprintf(to_write, buffer_size, "%u. %s", i, line);
-        write_to_text_box(to_write, col);
+    for (uint8_t i = 0; option_row[index] + i < option_row[index + 1]; ++i) {
+        uint8_t row = option_row[index] + i;
+        if (row >= TEXT_BOX_ROWS)
+            return 1;
 
-        free(to_write);
+        rectangle r = text_box_row(row);
+
+        if (i == 0) {
+            char number[2] = {'0' + index, '.'};
+            rectangle number_r = r;
+            number_r.right = r.left + OPTION_NUMBER_LENGTH * FONT_HEIGHT - 1;
+            r.left = number_r.right + 1;
+
+            if (!queue_option_run(number, sizeof(number), number_r, col, recolour))
+                return 0;
+        }
+
+        /* An option without text only has its number. */
+        if (i >= option->layout.size)
+            continue;
+
+        span line = option->layout.lines[i];
+        if (!queue_option_run(option->text + line.start, line.length, r, col,
+                recolour))
+            return 0;
     }
+
+    return 1;
+}
+
+uint8_t draw_text_box() {
+    uint8_t log_rows = option_row[0];
+
+    cli();
+    uint16_t count = log_count;
+    uint8_t scroll = log_scroll;
+    sei();
+
+    /* The log is shown from the top, with its newest line last. */
+    uint16_t newest = count - scroll;
+    uint16_t first = newest > log_rows ? newest - log_rows : 0;
+
+    /* Lines are never changed once logged, so rows still showing theirs are skipped. */
+    for (uint8_t row = 0; row < log_rows; ++row) {
+        uint16_t n = first + row;
+        uint16_t shows = n < newest ? n + 1 : BLANK_ROW;
+
+        if (shown_rows[row] == shows)
+            continue;
+
+        uint8_t queued;
+        if (shows == BLANK_ROW) {
+            queued = queue_fill(text_box_row(row), BLACK);
+        } else {
+            log_line* line = &log_lines[n % TEXT_BOX_LOG_LINES];
+            queued = queue_text_run(line->text, line->length, text_box_row(row),
+                    line->col, BLACK);
+        }
+
+        /* Rows are drawn in order, so the rest wait for the next frame. */
+        if (!queued)
+            return 0;
+
+        shown_rows[row] = shows;
+    }
+
+    if (options_drawn)
+        return 1;
+
+    for (uint8_t i = 0; i < shown_size; ++i)
+        if (!draw_option(i, i == shown_selected ? YELLOW : WHITE, 0))
+            return 0;
+
+    /* The rows under the options have to be redrawn once they are gone. */
+    for (uint8_t row = log_rows; row < TEXT_BOX_ROWS; ++row)
+        shown_rows[row] = 0;
+
+    options_drawn = 1;
+    return 1;
 }
@@ -3,10 +3,11 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 #include "lcd.h"
+#include "lcd_queue.h"
 #include "game_map.h"
 #include "interaction.h"
+#include "layout.h"
 
 /*
  * The screen shall be split in two "boxes", one to display the game map
@@ -22,23 +23,53 @@
 #define GAME_MAP_X_GAP 3
 #define GAME_MAP_Y_GAP 5
 
+#define GAME_MAP_CELL_WIDTH  (FONT_WIDTH + GAME_MAP_X_GAP)
+#define GAME_MAP_CELL_HEIGHT (FONT_HEIGHT + GAME_MAP_Y_GAP)
+
+/*
+ * Number of map cells that fit in the game map "box". Larger maps are shown
+ * through a camera that follows the player.
+ */
+#define GAME_MAP_VIEW_W ((GAME_MAP_X_MAX - GAME_MAP_X_MIN) / GAME_MAP_CELL_WIDTH)
+#define GAME_MAP_VIEW_H ((GAME_MAP_Y_MAX - GAME_MAP_Y_MIN) / GAME_MAP_CELL_HEIGHT)
+
 #define TEXT_BOX_X_MIN (LCDHEIGHT / 2 + 5)
 #define TEXT_BOX_Y_MIN 0
 #define TEXT_BOX_X_MAX LCDHEIGHT
 #define TEXT_BOX_Y_MAX LCDWIDTH
-#define TEXT_BOX_LINE_LENGTH (TEXT_BOX_X_MAX - TEXT_BOX_X_MIN) / (FONT_WIDTH - TEXT_OVERLAP)
+#define TEXT_BOX_LINE_LENGTH ((TEXT_BOX_X_MAX - TEXT_BOX_X_MIN) / (FONT_WIDTH - TEXT_OVERLAP))
+#define TEXT_BOX_LINE_PITCH  (FONT_HEIGHT + 5)
+#define TEXT_BOX_ROWS        ((TEXT_BOX_Y_MAX - TEXT_BOX_Y_MIN) / TEXT_BOX_LINE_PITCH)
 
-extern uint16_t text_box_y;
+/* Lines of dialogue kept for scrolling back through. A power of two. */
+#define TEXT_BOX_LOG_LINES 32
 
 void initialize_display();
 
-void draw_game_map(game_map* map);
-void clear_game_map();
-
-void write_to_text_box(const char* string, uint16_t col);
-void clear_text_box();
+/*
+ * Drawing only queues commands on the LCD queue. Functions that draw return
+ * 0 if the queue filled up before all of it was queued; calling them again
+ * once it has drained queues the rest.
+ */
+uint8_t draw_game_map(game_map* map);
+void invalidate_game_map();
+uint8_t clear_game_map();
 
-void write_interaction(interaction* current_interaction, const char* top_line, 
-        uint8_t selected_answer, uint8_t show_options);
+/*
+ * The text box shows the end of a log of everything written to it, word
+ * wrapped, with the options of the current interaction, if any, at the
+ * bottom. Changes are only drawn by draw_text_box().
+ *
+ * Options that do not all fit in the box are scrolled through as they are
+ * selected.
+ */
+void log_to_text_box(const char* text, uint16_t col);
+void scroll_text_box(int8_t lines);
+void set_text_box_options(interaction* current_interaction,
+        uint8_t selected_answer);
+void select_interaction_option(interaction* current_interaction,
+        uint8_t selected_answer);
+uint8_t draw_text_box();
+uint8_t clear_text_box();
 
 #endif /* DISPLAY_H */
@@ -0,0 +1,263 @@
+/**
+* Host harness for OSFS
+*
+* Formats a volume kept in a file through the file backend, writes, reads,
+* deletes and compacts files on it, and mounts it again, checking what is
+* read back at every step. A log-structured volume is then put through a
+* seeded random run of overwrites, deletes and small compactions, going
+* round the log a number of times, and checked against a copy of what it
+* should hold, also after mounting it again. Prints the time each step takes and the bytes it
+* moves through the backend, so that changes to OSFS can be measured on a PC.
+*
+* Built and run by "make host-osfs". Returns nonzero if a check fails.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "OSFS.h"
+#include "OSFS_backends.h"
+
+#define VOLUME_SIZE 4096
+#define FILES       24
+#define FILE_SIZE   40
+
+// The log volume, small enough for compact() to clean it all the time
+#define LOG_VOLUME_SIZE 2048
+#define LOG_FILES       12
+#define LOG_OPERATIONS  4000
+#define LOG_MIN_WRAPS   8
+
+static osfsBackend fileVolume;
+static osfsBackend countingVolume;
+
+static unsigned long bytesRead;
+static unsigned long bytesWritten;
+static clock_t stepStart;
+static int failures;
+
+// Counts the traffic of the file backend
+static result countingRead(uint16_t address, unsigned int num, byte* output) {
+    bytesRead += num;
+    return fileVolume.read(address, num, output);
+}
+
+static result countingWrite(uint16_t address, unsigned int num, const byte* input) {
+    bytesWritten += num;
+    return fileVolume.write(address, num, input);
+}
+
+static void startStep() {
+    bytesRead = 0;
+    bytesWritten = 0;
+    stepStart = clock();
+}
+
+static void endStep(const char* name) {
+    double us = (double) (clock() - stepStart) * 1e6 / CLOCKS_PER_SEC;
+    printf("%-10s %10.0f us %8lu B read %8lu B written\n", name, us, bytesRead, bytesWritten);
+}
+
+static void check(int ok, const char* what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void fileContents(uint16_t fileID, char* data) {
+    for (unsigned int i = 0; i < FILE_SIZE; i++)
+        data[i] = (char) (fileID * 7 + i);
+}
+
+// Checks that the files in [first, last) still read back, every <step>th
+static void checkFiles(const osfsVolume* vol, uint16_t first, uint16_t last, uint16_t step) {
+    char expected[FILE_SIZE];
+    char data[FILE_SIZE];
+    uint16_t read;
+
+    for (uint16_t id = first; id < last; id += step) {
+        fileContents(id, expected);
+
+        check(readFile(vol, id, 0, data, FILE_SIZE, &read) == NO_ERROR, "readFile");
+        check(read == FILE_SIZE && memcmp(data, expected, FILE_SIZE) == 0, "file contents");
+    }
+}
+
+// What the log volume should hold: size is -1 for a file not there
+static struct {
+    int size;
+    char data[OSFS_LOG_MAX_FILE];
+} logFiles[LOG_FILES];
+
+static uint32_t randomState = 1;
+
+static uint16_t randomNumber(uint16_t below) {
+    randomState = randomState * 1103515245u + 12345u;
+    return (uint16_t) ((randomState >> 16) % below);
+}
+
+static void checkLogFiles(const osfsVolume* vol) {
+    char data[OSFS_LOG_MAX_FILE];
+    uint16_t address, size, read;
+
+    for (uint16_t id = 0; id < LOG_FILES; id++) {
+        result r = getFileInfo(vol, id, &address, &size);
+
+        if (logFiles[id].size < 0) {
+            check(r == FILE_NOT_FOUND, "log file gone");
+            continue;
+        }
+
+        check(r == NO_ERROR && size == logFiles[id].size, "log file size");
+        check(readFile(vol, id, 0, data, OSFS_LOG_MAX_FILE, &read) == NO_ERROR
+              && read == size && memcmp(data, logFiles[id].data, read) == 0, "log file contents");
+    }
+}
+
+static void logPass(const char* path) {
+    osfsVolume vol;
+    unsigned int wraps = 0;
+    unsigned int cleaned = 0;
+
+    if (fileBackend(&fileVolume, path, LOG_VOLUME_SIZE) != NO_ERROR) {
+        check(0, "open log volume");
+        return;
+    }
+
+    countingVolume = fileVolume;
+    countingVolume.read = countingRead;
+    countingVolume.write = countingWrite;
+    useBackend(&countingVolume);
+
+    check(formatLog(&vol) == NO_ERROR, "formatLog");
+
+    for (uint16_t id = 0; id < LOG_FILES; id++)
+        logFiles[id].size = -1;
+
+    startStep();
+    for (unsigned int op = 0; op < LOG_OPERATIONS; op++) {
+        uint16_t id = randomNumber(LOG_FILES);
+        uint16_t end = vol.end;
+        uint16_t pick = randomNumber(10);
+
+        if (pick < 6) {
+            int size = randomNumber(OSFS_LOG_MAX_FILE + 1);
+
+            for (int i = 0; i < size; i++)
+                logFiles[id].data[i] = (char) randomNumber(256);
+
+            check(newFile(&vol, id, logFiles[id].data, size, 1) == NO_ERROR, "log overwrite");
+            logFiles[id].size = size;
+        } else if (pick < 8) {
+            check(deleteFile(&vol, id) == (logFiles[id].size < 0 ? FILE_NOT_FOUND : NO_ERROR), "log delete");
+            logFiles[id].size = -1;
+        } else {
+            uint16_t deleted = vol.deletedSpace;
+
+            check(compact(&vol, 1 + randomNumber(48)) == NO_ERROR, "log compact");
+
+            if (vol.deletedSpace < deleted)
+                cleaned++;
+        }
+
+        if (vol.end < end)
+            wraps++;
+
+        if (op % 256 == 0)
+            checkLogFiles(&vol);
+    }
+    endStep("log ops");
+
+    check(wraps >= LOG_MIN_WRAPS, "log wraps");
+    check(cleaned != 0, "log cleaned by compact");
+    checkLogFiles(&vol);
+
+    useBackend(&countingVolume);
+
+    startStep();
+    check(mount(&vol) == NO_ERROR, "log mount");
+    endStep("log mount");
+
+    checkLogFiles(&vol);
+    printf("log went round %u times, cleaned by %u compactions\n", wraps, cleaned);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "osfs.img";
+    osfsVolume vol;
+    char data[FILE_SIZE];
+    uint16_t read;
+
+    remove(path);
+
+    if (fileBackend(&fileVolume, path, VOLUME_SIZE) != NO_ERROR) {
+        printf("FAILED: cannot open %s\n", path);
+        return 1;
+    }
+
+    countingVolume = fileVolume;
+    countingVolume.read = countingRead;
+    countingVolume.write = countingWrite;
+    useBackend(&countingVolume);
+
+    startStep();
+    check(format(&vol) == NO_ERROR, "format");
+    endStep("format");
+
+    startStep();
+    for (uint16_t id = 0; id < FILES; id++) {
+        fileContents(id, data);
+        check(newFile(&vol, id, data, FILE_SIZE, 0) == NO_ERROR, "newFile");
+    }
+    endStep("write");
+
+    startStep();
+    checkFiles(&vol, 0, FILES, 1);
+    endStep("read");
+
+    // A ranged read stops at the end of the file
+    check(readFile(&vol, 3, FILE_SIZE - 4, data, FILE_SIZE, &read) == NO_ERROR && read == 4, "ranged read");
+
+    startStep();
+    for (uint16_t id = 0; id < FILES; id += 2)
+        check(deleteFile(&vol, id) == NO_ERROR, "deleteFile");
+    endStep("delete");
+
+    check(readFile(&vol, 0, 0, data, FILE_SIZE, &read) == FILE_NOT_FOUND, "deleted file gone");
+
+    uint16_t freeBefore = vol.freeSpace;
+
+    startStep();
+    for (unsigned int calls = 0; vol.deletedSpace != 0 || vol.compactNext != 0; calls++) {
+        if (calls == VOLUME_SIZE) {
+            check(0, "compact finishes");
+            break;
+        }
+
+        check(compact(&vol, 64) == NO_ERROR, "compact");
+    }
+    endStep("compact");
+
+    check(vol.freeSpace == freeBefore + (FILES / 2) * (sizeof(fileHeader) + FILE_SIZE), "space reclaimed");
+    checkFiles(&vol, 1, FILES, 2);
+
+    // The volume in the file is what a fresh mount sees
+    useBackend(&countingVolume);
+
+    startStep();
+    check(mount(&vol) == NO_ERROR, "mount");
+    endStep("mount");
+
+    checkFiles(&vol, 1, FILES, 2);
+
+    char logPath[256];
+    snprintf(logPath, sizeof(logPath), "%s.log", path);
+    remove(logPath);
+    logPass(logPath);
+
+    if (failures != 0)
+        return 1;
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+* Host harness for dialogue content packs on an SD card
+*
+* Builds a card image holding the dialogue as a content pack, the way
+* mount_dialogue() expects one on a card: an OSFS volume from sector
+* DIALOGUE_CARD_SECTOR on, with the lines packed as they are in the firmware.
+* Then brings the image up as a card again, mounts the pack through the SD
+* backend and its sector cache, and reads every line back through a text
+* reader. Sector 0 stands for the MBR of the card, and must come out as it
+* went in.
+*
+* Built and run by "make host-sd". The volume can be copied onto a real card
+* with e.g. "dd if=card.img of=/dev/sdX bs=512 skip=1024 seek=1024", for
+* DIALOGUE_CARD_SECTOR sectors skipped. Returns nonzero if a check fails.
+*/
+
+#include <stdio.h>
+#include "OSFS.h"
+#include "OSFS_backends.h"
+#include "sd_card.h"
+#include "dialogue.h"
+#include "text_reader.h"
+
+#define PACK_ENTRY(field, file_id, line) {file_id, line, sizeof(line) - 1, NO_ERROR},
+#define EXPECTED_LINE(identifier, file_id, text) {file_id, text},
+
+static newFileEntry packFiles[] = { DIALOGUE_PACKED(PACK_ENTRY) };
+
+static const struct {
+    uint16_t fileID;
+    const char* text;
+} expectedLines[] = { DIALOGUE_FILES(EXPECTED_LINE) };
+
+#define FILE_COUNT (sizeof(packFiles) / sizeof(packFiles[0]))
+
+static int failures;
+
+static void check(int ok, const char* what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// A boot sector, so that writing over it does not go unnoticed
+static void bootSector(uint8_t* sector) {
+    for (unsigned int i = 0; i < SD_SECTOR_SIZE; i++)
+        sector[i] = (uint8_t) i;
+
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+}
+
+static result writePack(const char* path) {
+    uint8_t sector[SD_SECTOR_SIZE];
+    osfsBackend card;
+    osfsVolume vol;
+
+    FILE* image = fopen(path, "wb");
+
+    if (image == NULL)
+        return UNDEFINED_ERROR;
+
+    bootSector(sector);
+    size_t written = fwrite(sector, 1, SD_SECTOR_SIZE, image);
+
+    if (fclose(image) != 0 || written != SD_SECTOR_SIZE)
+        return UNDEFINED_ERROR;
+
+    sdCardImage(path);
+
+    result r = sdBackend(&card, DIALOGUE_CARD_SECTOR, DIALOGUE_CARD_SIZE);
+
+    if (r != NO_ERROR)
+        return r;
+
+    useBackend(&card);
+
+    r = format(&vol);
+
+    if (r == NO_ERROR)
+        r = newFiles(&vol, packFiles, FILE_COUNT);
+
+    if (r == NO_ERROR)
+        r = sdFlush();
+
+    return r;
+}
+
+static void readPack(const char* path) {
+    uint8_t expected[SD_SECTOR_SIZE];
+    uint8_t sector[SD_SECTOR_SIZE];
+    osfsBackend card;
+    osfsVolume vol;
+
+    // As mount_dialogue() does with a card in the slot
+    sdCardImage(NULL);
+    sdCardImage(path);
+
+    check(sdCardPresent(), "card present");
+    check(sdBackend(&card, DIALOGUE_CARD_SECTOR, DIALOGUE_CARD_SIZE) == NO_ERROR, "sdBackend");
+    useBackend(&card);
+    check(mount(&vol) == NO_ERROR, "mount");
+
+    for (unsigned int i = 0; i < FILE_COUNT; i++) {
+        char line[MAX_LINE_SIZE];
+        text_reader reader;
+        uint8_t length = 0;
+
+        check(open_text(&reader, &vol, expectedLines[i].fileID) == NO_ERROR, "open_text");
+
+        while (length < MAX_LINE_SIZE - 1 && (line[length] = read_text_char(&reader)) != '\0')
+            length++;
+        line[length] = '\0';
+
+        if (strcmp(line, expectedLines[i].text) != 0) {
+            printf("line %04x: \"%s\"\n", expectedLines[i].fileID, line);
+            check(0, "line read back");
+        }
+    }
+
+    bootSector(expected);
+    check(sdReadSector(0, sector) == NO_ERROR && memcmp(sector, expected, SD_SECTOR_SIZE) == 0,
+          "boot sector untouched");
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "card.img";
+
+    if (writePack(path) != NO_ERROR) {
+        printf("FAILED: cannot write a content pack to %s\n", path);
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < FILE_COUNT; i++)
+        check(packFiles[i].status == NO_ERROR, "pack file stored");
+
+    readPack(path);
+
+    if (failures != 0)
+        return 1;
+
+    printf("ok: %u lines\n", (unsigned int) FILE_COUNT);
+    return 0;
+}
@@ -4,25 +4,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <stdio.h>
 #include "game_map.h"
 #include "OSFS.h"
+#include "dialogue.h"
+#include "text_reader.h"
 
 #define WIN_CODE 42u
 
 #define MAX_INTERACTIONS 6
-#define MAX_LINE_SIZE    80
 #define MAX_OPTIONS      4
 #define NONE_SELECTED    32
 #define MAX_NAME_SIZE    10
 
 typedef enum {npc, scene} interaction_type;
 
-typedef struct text {
-    char player_file[MAX_NAME_SIZE];
-    char world_file[MAX_NAME_SIZE];
-} text;
-
 typedef struct interaction {
     interaction_type type;
 
@@ -30,12 +25,10 @@ typedef struct interaction {
     char on_map;
     position pos;
 
-    char greet_file[MAX_NAME_SIZE];
-    char current_line[MAX_LINE_SIZE];
+    uint8_t dialogue; /* Number of the interaction in the IDs of its lines. */
 
     size_t size_options;
     uint8_t showing;
-    text options[MAX_OPTIONS];
 
     uint8_t (*on_select_option)(game_map* map, uint8_t selected_index);
 } interaction;
@@ -47,11 +40,22 @@ interaction* find_interaction_by_char(const char c);
 interaction* find_interaction_by_pos(position pos);
 interaction* find_interaction_by_name(const char* name);
 
-uint16_t add_line(interaction* inter, const char* player_line, const char* world_line);
-uint16_t remove_line(interaction* inter, const uint8_t index);
+/*
+ * Options are numbered from 0 to size_options - 1, but only those whose
+ * conditions hold are shown, and numbered again from 0 on screen.
+ * shown_options() returns them as one bit per option.
+ */
+uint8_t shown_options(interaction* inter);
+uint8_t count_options(uint8_t shown);
+
+/* The option shown as number <index>, or NONE_SELECTED if there is none. */
+uint8_t shown_option(uint8_t shown, uint8_t index);
 
 void get_player_line(char* buf, interaction* inter, size_t index);
 void get_world_line(char* buf, interaction* inter, size_t index);
 void get_greet_line(char* buf, interaction* inter);
 
+/* Start streaming a player line, for text that is not read into a buffer. */
+result open_player_line(text_reader* reader, interaction* inter, size_t index);
+
 #endif /* INTERACTION_H */
@@ -0,0 +1,89 @@
+#include "layout.h"
+#include <string.h>
+
+uint8_t layout_text(const char* text, uint8_t width, text_layout* layout) {
+    uint8_t start = 0;
+    layout->size = 0;
+
+    while (text[start] != '\0') {
+        /* Lines do not start with the space they were broken at. */
+        if (text[start] == ' ') {
+            start++;
+            continue;
+        }
+
+        if (layout->size == LAYOUT_MAX_LINES)
+            return 1;
+
+        /* Find the end of the line and the last space in it. */
+        uint8_t end = start;
+        uint8_t last_space = start;
+        while (end - start < width && text[end] != '\0') {
+            if (text[end] == ' ')
+                last_space = end;
+            end++;
+        }
+
+        uint8_t length;
+        if (text[end] == '\0' || text[end] == ' ')
+            length = end - start;
+        else if (last_space != start)
+            length = last_space - start;
+        else
+            length = end - start;
+
+        layout->lines[layout->size++] = (span) {start, length};
+        start += length;
+    }
+
+    return 0;
+}
+
+void open_line_stream(line_stream* stream, char_source next, void* source) {
+    stream->next = next;
+    stream->source = source;
+    stream->size = 0;
+    stream->taken = 0;
+    stream->ended = 0;
+}
+
+uint8_t next_line(line_stream* stream, uint8_t width) {
+    if (width > LAYOUT_MAX_WIDTH)
+        width = LAYOUT_MAX_WIDTH;
+
+    /* Drop the line returned last, and the spaces it was broken at. */
+    uint8_t start = stream->taken;
+    while (start < stream->size && stream->text[start] == ' ')
+        start++;
+
+    stream->size -= start;
+    memmove(stream->text, stream->text + start, stream->size);
+    stream->taken = 0;
+
+    /* Read up to the character after the longest line that fits. */
+    while (!stream->ended && stream->size <= width) {
+        char c = stream->next(stream->source);
+
+        if (c == '\0')
+            stream->ended = 1;
+        else if (c != ' ' || stream->size != 0)
+            stream->text[stream->size++] = c;
+    }
+
+    uint8_t length = stream->size;
+    if (length > width) {
+        length = width;
+
+        if (stream->text[width] != ' ') {
+            uint8_t last_space = width;
+            while (last_space > 0 && stream->text[last_space - 1] != ' ')
+                last_space--;
+
+            if (last_space > 1)
+                length = last_space - 1;
+        }
+    }
+
+    stream->taken = length;
+    return length;
+}
@@ -0,0 +1,59 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+/*
+ * Word wrapping of text into lines of a fixed number of characters. A text
+ * is laid out once into spans pointing back into it, which can then be drawn
+ * straight from the text as many times as needed.
+ */
+
+#define LAYOUT_MAX_LINES 8
+
+typedef struct span {
+    uint8_t start;
+    uint8_t length;
+} span;
+
+typedef struct text_layout {
+    uint8_t size;
+    span lines[LAYOUT_MAX_LINES];
+} text_layout;
+
+/*
+ * Break <text> into lines of at most <width> characters, at spaces where
+ * possible. Words longer than a line are split. Returns 1 if the text needs
+ * more than LAYOUT_MAX_LINES lines, in which case only those are laid out.
+ */
+uint8_t layout_text(const char* text, uint8_t width, text_layout* layout);
+
+/*
+ * The same word wrapping, for text that is read a character at a time and
+ * never held whole, e.g. straight from storage. Only the line being laid out
+ * and the character after it are kept.
+ */
+
+#define LAYOUT_MAX_WIDTH 32
+
+/* Returns the next character of <source>, or '\0' at its end. */
+typedef char (*char_source)(void* source);
+
+typedef struct line_stream {
+    char_source next;
+    void* source;
+    char text[LAYOUT_MAX_WIDTH + 1];  /* The line, and what was read after it. */
+    uint8_t size;
+    uint8_t taken;                    /* Length of the line last returned. */
+    uint8_t ended;
+} line_stream;
+
+void open_line_stream(line_stream* stream, char_source next, void* source);
+
+/*
+ * Lay out the next line, of at most <width> characters, and leave it at the
+ * start of stream->text. Returns its length, or 0 once the text has ended.
+ */
+uint8_t next_line(line_stream* stream, uint8_t width);
+
+#endif /* LAYOUT_H */
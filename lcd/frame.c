@@ -0,0 +1,214 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "lcd.h"
+#include "lcd_queue.h"
+#include "frame.h"
+
+#define TE_TIMEOUT_TICKS ((uint16_t) (FRAME_TIMER_HZ * FRAME_TE_TIMEOUT_MS / 1000))
+
+/* Incremented on every TE pulse, at the start of a frame. */
+volatile uint8_t te_frames = 0;
+
+/* Timer 3 ticks between the last two TE pulses, 0 until measured. */
+volatile uint16_t frame_ticks = 0;
+
+/* TE pulses to pass before timing a frame, after a change of frame rate. */
+volatile uint8_t untimed_frames = 0;
+
+/* Timer 3 ticks it takes to draw 1024 pixels, as last measured. */
+uint16_t ticks_per_kpx = FRAME_INITIAL_TICKS_PER_KPX;
+
+void (*updates[FRAME_MAX_UPDATES])(void);
+volatile uint8_t updates_size = 0;
+
+uint8_t frames_per_flush = 1;
+uint8_t last_flush = 0;
+uint8_t panel_idle = 0;
+
+ISR(INT6_vect) {
+    /* A timer that ran over has not timed a whole frame. */
+    if (untimed_frames != 0)
+        untimed_frames--;
+    else if (!(TIFR3 & _BV(TOV3)))
+        frame_ticks = TCNT3;
+
+    TCNT3 = 0;
+    TIFR3 = _BV(TOV3);  /* cleared by writing a one */
+    te_frames++;
+}
+
+void init_frame_pacing(uint8_t target_hz) {
+    set_frame_rate_hz(FRAME_PANEL_HZ);
+    set_target_frame_rate(target_hz);
+
+    /* Timer 3 in normal mode at F_CPU / 64, to time the frames. */
+    TCCR3A = 0;
+    TCCR3B = _BV(CS31) | _BV(CS30);
+
+    /* init_lcd() has set up INT6 to trigger on the falling TE edge. */
+    EIFR = _BV(INTF6);
+    EIMSK |= _BV(INT6);
+}
+
+void set_target_frame_rate(uint8_t target_hz) {
+    if (target_hz == 0 || target_hz > FRAME_PANEL_HZ)
+        target_hz = FRAME_PANEL_HZ;
+
+    frames_per_flush = FRAME_PANEL_HZ / target_hz;
+}
+
+uint8_t queue_frame_update(void (*update)(void)) {
+    uint8_t queued = 1;
+
+    cli();
+    uint8_t i;
+    for (i = 0; i < updates_size && updates[i] != update; ++i);
+
+    if (i == updates_size) {
+        if (updates_size == FRAME_MAX_UPDATES)
+            queued = 0;
+        else
+            updates[updates_size++] = update;
+    }
+    sei();
+
+    return queued;
+}
+
+/* The first line the panel scans of the columns <left> to <right>. */
+static int16_t scan_line(uint16_t left, uint16_t right) {
+#if FRAME_SCAN_REVERSED
+    (void) left;
+    return LCDHEIGHT - 1 - right;
+#else
+    (void) right;
+    return left;
+#endif
+}
+
+/*
+ * Whether the scan, at line <now>, stays clear of <r> for the <lines> it
+ * moves while <r> is drawn: it does not get to <r> before then, or it has
+ * already passed <r> and does not come back round to it before then.
+ */
+static uint8_t clear_of_scan(rectangle r, int16_t now, int32_t lines) {
+    int16_t first = scan_line(r.left, r.right) - FRAME_SCAN_MARGIN;
+    int16_t last = first + (r.right - r.left) + 2 * FRAME_SCAN_MARGIN;
+
+    if (now + lines < first)
+        return 1;
+
+    if (now <= last)
+        return 0;
+
+    /* What takes longer than a frame is drawn right behind the scan. */
+    return now + lines < first + FRAME_SCAN_LINES
+        || lines >= FRAME_SCAN_LINES - (last - first);
+}
+
+/*
+ * Draws queued commands for as long as the scan stays clear of them, and
+ * FRAME_SLICE_PIXELS of them if there is no TE line to time it by. Returns 0
+ * once the queue is empty.
+ */
+static uint8_t draw_clear_of_scan() {
+    rectangle r;
+
+    while (peek_lcd_queue(&r, FRAME_SLICE_PIXELS)) {
+        cli();
+        uint8_t frame = te_frames;
+        uint16_t period = frame_ticks;
+        uint16_t start = TCNT3;
+        uint8_t lost = TIFR3 & _BV(TOV3);
+        sei();
+
+        if (lost || start > TE_TIMEOUT_TICKS)
+            return drain_lcd_queue(FRAME_SLICE_PIXELS);
+
+        /* The frame period is being timed again. */
+        if (period == 0)
+            return 1;
+
+        uint32_t pixels = (uint32_t) (r.right - r.left + 1) * (r.bottom - r.top + 1);
+        uint32_t ticks = pixels * ticks_per_kpx / 1024;
+        int16_t now = (uint32_t) start * FRAME_SCAN_LINES / period;
+        int32_t lines = ticks * FRAME_SCAN_LINES / period;
+
+        if (now >= FRAME_SCAN_LINES || !clear_of_scan(r, now, lines))
+            return 1;
+
+        draw_lcd_command(FRAME_SLICE_PIXELS);
+
+        cli();
+        uint16_t end = TCNT3;
+        uint8_t same_frame = te_frames == frame;
+        sei();
+
+        /*
+         * Keep up with slower drawing straight away and with faster drawing
+         * slowly, so that a fast command does not make the next look safe.
+         */
+        if (same_frame && pixels >= 64) {
+            uint32_t measured = (uint32_t) (end - start) * 1024 / pixels;
+            if (measured > 0xFFFF)
+                measured = 0xFFFF;
+
+            if (measured > ticks_per_kpx)
+                ticks_per_kpx = measured;
+            else
+                ticks_per_kpx -= (ticks_per_kpx - measured) / 8;
+        }
+    }
+
+    return 0;
+}
+
+int flush_frames(int state) {
+    /* Finish drawing the last frame before starting on the next one. */
+    if (draw_clear_of_scan())
+        return state;
+
+    if (updates_size == 0) {
+        if (!panel_idle && (uint8_t) (te_frames - last_flush) >= FRAME_IDLE_AFTER) {
+            set_frame_rate_hz(FRAME_IDLE_HZ);
+            panel_idle = 1;
+        }
+
+        return state;
+    }
+
+    if (panel_idle) {
+        set_frame_rate_hz(FRAME_PANEL_HZ);
+        panel_idle = 0;
+
+        /*
+         * The idle period no longer holds, and the frame under way when the
+         * rate changed is neither, so the next whole frame is timed.
+         */
+        cli();
+        frame_ticks = 0;
+        untimed_frames = 1;
+        sei();
+    } else if ((uint8_t) (te_frames - last_flush) < frames_per_flush) {
+        return state;
+    }
+
+    /* Take the queue, so updates can be queued again while these run. */
+    void (*to_run[FRAME_MAX_UPDATES])(void);
+
+    cli();
+    uint8_t size = updates_size;
+    for (uint8_t i = 0; i < size; ++i)
+        to_run[i] = updates[i];
+    updates_size = 0;
+    sei();
+
+    /* The updates only queue drawing commands; nothing is drawn yet. */
+    for (uint8_t i = 0; i < size; ++i)
+        to_run[i]();
+
+    last_flush = te_frames;
+    draw_clear_of_scan();
+
+    return state;
+}
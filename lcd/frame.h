@@ -0,0 +1,68 @@
+/*
+ * Frame pacing for the LCD.
+ *
+ * Updates to the display are queued by the game and run together by a RIOS
+ * task. They queue their drawing on the LCD command queue, which the task
+ * drains by chasing the panel's scan: the tearing effect (TE) line marks the
+ * start of each frame, and Timer 3 the time since, from which the task works
+ * out the line the panel is reading. A command is only drawn while the scan
+ * stays clear of it until it is done, either still ahead of it or already
+ * past it and not back before the next frame; otherwise the task leaves it
+ * for a later run. How long drawing takes is measured as it goes.
+ *
+ * Updates are flushed at most at the target frame rate, and only once
+ * everything queued for the previous frame has been drawn. While nothing is
+ * queued the panel is refreshed at a lower rate to save power.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include "lcd.h"
+
+#define FRAME_MAX_UPDATES 4
+
+#define FRAME_PANEL_HZ   60  /* panel refresh rate while drawing */
+#define FRAME_IDLE_HZ    20  /* panel refresh rate while static */
+#define FRAME_IDLE_AFTER 60  /* frames without updates before going idle */
+
+/* Timer 3 runs freely at this rate, and is reset by every TE pulse. */
+#define FRAME_TIMER_HZ (F_CPU / 64)
+
+/*
+ * Lines the panel scans each frame, its porches included. In the West
+ * orientation its lines run along x, from the right edge of the screen
+ * (MADCTL 0xE8 sets MY), which FRAME_SCAN_REVERSED maps back.
+ */
+#define FRAME_SCAN_LINES    (LCDHEIGHT + 4)
+#define FRAME_SCAN_REVERSED 1
+
+/* Lines kept between the scan and a command, for the error in timing it. */
+#define FRAME_SCAN_MARGIN 8
+
+/* Drawing time assumed before any is measured: 512 ticks per 1024 pixels. */
+#define FRAME_INITIAL_TICKS_PER_KPX 512
+
+/* Pixels of a fill drawn at once, and drawn each run without the TE line. */
+#define FRAME_SLICE_PIXELS 2048
+
+/*
+ * Time without a TE pulse after which the panel is taken not to send any.
+ * Longer than a frame at FRAME_IDLE_HZ, so that an idle panel still counts.
+ */
+#define FRAME_TE_TIMEOUT_MS (1000 / FRAME_IDLE_HZ + 10)
+
+void init_frame_pacing(uint8_t target_hz);
+void set_target_frame_rate(uint8_t target_hz);
+
+/*
+ * Queue an update to run in the next frame. An update that is already queued
+ * is only run once. Returns 0 if the queue is full.
+ */
+uint8_t queue_frame_update(void (*update)(void));
+
+/* RIOS task running the queued updates and drawing what they queue. */
+int flush_frames(int state);
+
+#endif /* FRAME_H */
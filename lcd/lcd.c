@@ -121,7 +121,13 @@ void set_frame_rate_hz(uint8_t f)
     write_data(rtna);
 }
 
-void fill_rectangle(rectangle r, uint16_t col)
+/*
+ * Everything below streams pixels into an address window. Once the window is
+ * set the controller takes a pixel for every two stores to DATA_ADDR, so the
+ * loops keep their colours in registers and are unrolled to spend as few
+ * cycles as possible between stores.
+ */
+static void set_window(rectangle r)
 {
     write_cmd(COLUMN_ADDRESS_SET);
     write_data16(r.left);
@@ -130,32 +136,41 @@ void fill_rectangle(rectangle r, uint16_t col)
     write_data16(r.top);
     write_data16(r.bottom);
     write_cmd(MEMORY_WRITE);
-/*  uint16_t x, y;
-    for(x=r.left; x<=r.right; x++)
-        for(y=r.top; y<=r.bottom; y++)
-            write_data16(col);
-*/
-    uint16_t wpixels = r.right - r.left + 1;
-    uint16_t hpixels = r.bottom - r.top + 1;
-    uint8_t mod8, div8;
-    uint16_t odm8, odd8;
-    if (hpixels > wpixels) {
-        mod8 = hpixels & 0x07;
-        div8 = hpixels >> 3;
-        odm8 = wpixels*mod8;
-        odd8 = wpixels*div8;
-    } else {
-        mod8 = wpixels & 0x07;
-        div8 = wpixels >> 3;
-        odm8 = hpixels*mod8;
-        odd8 = hpixels*div8;
-    }
-    uint8_t pix1 = odm8 & 0x07;
+}
+
+/* Writes eight pixels, one per bit of <bits> starting at the top one. */
+static inline void write_bits8(uint8_t bits, uint16_t fg, uint16_t bg)
+{
+    write_data16((bits & 0x80) ? fg : bg);
+    write_data16((bits & 0x40) ? fg : bg);
+    write_data16((bits & 0x20) ? fg : bg);
+    write_data16((bits & 0x10) ? fg : bg);
+    write_data16((bits & 0x08) ? fg : bg);
+    write_data16((bits & 0x04) ? fg : bg);
+    write_data16((bits & 0x02) ? fg : bg);
+    write_data16((bits & 0x01) ? fg : bg);
+}
+
+/*
+ * Writes <n> pixels of a single colour. A full screen is more pixels than
+ * fit in 16 bits, but not more than 16 bits' worth of blocks of 16.
+ */
+static void write_run(uint32_t n, uint16_t col)
+{
+    uint8_t pix1 = n & 0x0F;
+    uint16_t pix16 = n >> 4;
+
     while(pix1--)
         write_data16(col);
-
-    uint16_t pix8 = odd8 + (odm8 >> 3);
-    while(pix8--) {
+    while(pix16--) {
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
         write_data16(col);
         write_data16(col);
         write_data16(col);
@@ -167,19 +182,92 @@ void fill_rectangle(rectangle r, uint16_t col)
     }
 }
 
+void fill_rectangle(rectangle r, uint16_t col)
+{
+    set_window(r);
+    write_run((uint32_t) (r.right - r.left + 1) * (r.bottom - r.top + 1), col);
+}
+
+/*
+ * Copies <n> pixels from <px> into the current window.
+ */
+static void write_pixels(const uint16_t* px, uint16_t n)
+{
+    uint8_t pix1 = n & 0x07;
+    uint16_t pix8 = n >> 3;
+
+    while(pix1--)
+        write_data16(*px++);
+    while(pix8--) {
+        write_data16(px[0]);
+        write_data16(px[1]);
+        write_data16(px[2]);
+        write_data16(px[3]);
+        write_data16(px[4]);
+        write_data16(px[5]);
+        write_data16(px[6]);
+        write_data16(px[7]);
+        px += 8;
+    }
+}
+
+/*
+ * Fills <r> from a buffer of its pixels, row by row in the West orientation
+ * the display is left in.
+ */
 void fill_rectangle_indexed(rectangle r, uint16_t* col)
 {
-    uint16_t x, y;
-    write_cmd(COLUMN_ADDRESS_SET);
-    write_data16(r.left);
-    write_data16(r.right);
-    write_cmd(PAGE_ADDRESS_SET);
-    write_data16(r.top);
-    write_data16(r.bottom);
-    write_cmd(MEMORY_WRITE);
-    for(x=r.left; x<=r.right; x++)
-        for(y=r.top; y<=r.bottom; y++)
-            write_data16(*col++);
+    set_window(r);
+    write_pixels(col, (r.right - r.left + 1) * (r.bottom - r.top + 1));
+}
+
+/*
+ * Draws a 1 bit per pixel bitmap into <r> with colours palette[0] and
+ * palette[1]. Rows start on a byte boundary, with the leftmost pixel in the
+ * most significant bit.
+ */
+void blit_1bpp(rectangle r, const uint8_t* bits, const uint16_t* palette)
+{
+    uint16_t width = r.right - r.left + 1;
+    uint16_t height = r.bottom - r.top + 1;
+    uint16_t fg = palette[1], bg = palette[0];
+    uint16_t row, i;
+    uint8_t mask;
+
+    set_window(r);
+    for(row=0; row<height; row++) {
+        for(i=0; i<width / 8; i++)
+            write_bits8(*bits++, fg, bg);
+        if (width % 8) {
+            for(mask=0x80; mask != (0x80 >> width % 8); mask>>=1)
+                write_data16((*bits & mask) ? fg : bg);
+            bits++;
+        }
+    }
+}
+
+/*
+ * Draws a 4 bits per pixel bitmap into <r> through a palette of 16 colours.
+ * Rows start on a byte boundary, with the left pixel of each pair in the top
+ * nibble.
+ */
+void blit_4bpp(rectangle r, const uint8_t* px, const uint16_t* palette)
+{
+    uint16_t width = r.right - r.left + 1;
+    uint16_t height = r.bottom - r.top + 1;
+    uint16_t row, i;
+    uint8_t b;
+
+    set_window(r);
+    for(row=0; row<height; row++) {
+        for(i=0; i<width / 2; i++) {
+            b = *px++;
+            write_data16(palette[b >> 4]);
+            write_data16(palette[b & 0x0F]);
+        }
+        if (width % 2)
+            write_data16(palette[*px++ >> 4]);
+    }
 }
 
 void clear_screen()
@@ -190,50 +278,81 @@ void clear_screen()
     fill_rectangle(r, display.background);
 }
 
-void display_char(char c, uint16_t col)
+/*
+ * The glyph is drawn in the West orientation the display is left in. There
+ * the address counter runs along a row before moving down to the next one,
+ * which is the order font8x16 is stored in (one byte per row, most
+ * significant bit on the left), so the whole glyph goes out through a single
+ * address window and one MEMORY_WRITE burst.
+ */
+static void display_glyph(char c, uint16_t x, uint16_t y, uint8_t rows, uint16_t col)
 {
-    uint16_t x, y;
     const uint8_t* fdata;
-    uint8_t bits, mask;
-    uint16_t sc=display.x, ec=display.x + 15, sp=display.y, ep=display.y + 7;
+    rectangle w = {x, x + FONT_HEIGHT - 1, y, y + rows - 1};
+    uint8_t r;
 
     if (c < 32 || c > 126) return;
     fdata = (c - ' ') * 16 + font8x16;
-    write_cmd(PAGE_ADDRESS_SET);
-    write_data16(sp);
-    write_data16(ep);
-    for(x=sc; x<=ec; x++) {
-        write_cmd(COLUMN_ADDRESS_SET);
-        write_data16(x);
-        write_data16(x);
-        write_cmd(MEMORY_WRITE);
-        bits = pgm_read_byte(fdata++);
-        for(y=sp, mask=0x01; y<=ep; y++, mask<<=1)
-            write_data16((bits & mask) ? col : display.background);
-    }
-    /*
-    write_cmd(COLUMN_ADDRESS_SET);
-    write_data16(x);
-    write_data16(x);
-    write_cmd(MEMORY_WRITE);
-    for(y=sp; y<=ep; y++)
-        write_data16(display.background);
-    */
-
-    display.x += 6;
-    if (display.x >= display.width) { display.x=0; display.y+=8; }
+    set_window(w);
+    for(r=0; r<rows; r++)
+        write_bits8(pgm_read_byte(fdata++), col, display.background);
+}
 
+void display_char(char c, uint16_t col)
+{
+    display_glyph(c, display.x, display.y, FONT_WIDTH, col);
 
+    display.x += FONT_WIDTH - TEXT_OVERLAP;
+    if (display.x + FONT_HEIGHT > display.width) { display.x=0; display.y+=FONT_WIDTH; }
 }
 
 void display_char_xy(char c, uint16_t x, uint16_t y, uint16_t col)
 {
+    display_glyph(c, x, y, FONT_WIDTH, col);
+}
 
-    set_orientation(North);
-    display.x = y;
-    display.y = 310 - x;
-    display_char(c, col);
-    set_orientation(West);
+/*
+ * Only the first <rows> rows of the glyph are drawn, so that a glyph does not
+ * paint over the top of whatever is drawn just below it.
+ */
+void display_char_clip_xy(char c, uint16_t x, uint16_t y, uint8_t rows, uint16_t col)
+{
+    display_glyph(c, x, y, rows, col);
+}
+
+/*
+ * Draws up to <length> characters of <str>, stopping early at its end or when
+ * the next glyph would not fit, along the top of <r>. Every pixel of <r> not
+ * covered by a glyph is filled with <bg>, so the run overwrites whatever was
+ * there before in a single MEMORY_WRITE and nothing needs clearing first.
+ */
+void display_text_run(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg)
+{
+    uint16_t width = r.right - r.left + 1;
+    uint16_t height = r.bottom - r.top + 1;
+    uint16_t row, pad;
+    uint8_t n, i, bits;
+    char c;
+
+    for(n=0; n<length && str[n] && (n + 1) * FONT_HEIGHT <= width; n++)
+        ;
+    pad = width - n * FONT_HEIGHT;
+
+    set_window(r);
+    for(row=0; row<height; row++) {
+        /* Below the glyphs the whole row is padding. */
+        if (row >= FONT_WIDTH) {
+            write_run((uint32_t) (height - row) * width, bg);
+            return;
+        }
+        for(i=0; i<n; i++) {
+            c = str[i];
+            bits = (c >= 32 && c <= 126)
+                   ? pgm_read_byte(font8x16 + (c - ' ') * 16 + row) : 0;
+            write_bits8(bits, fg, bg);
+        }
+        write_run(pad, bg);
+    }
 }
 
 void display_string(char *str, uint16_t col)
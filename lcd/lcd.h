@@ -2,7 +2,10 @@
  * Licence: This work is licensed under the Creative Commons Attribution License.
  *           View this license at http://creativecommons.org/about/licenses/
  */
- 
+
+#ifndef LCD_H
+#define LCD_H
+
 #include <avr/io.h>
 #include <stdint.h>
 
@@ -47,7 +50,13 @@ void set_frame_rate_hz(uint8_t f);
 void clear_screen();
 void fill_rectangle(rectangle r, uint16_t col);
 void fill_rectangle_indexed(rectangle r, uint16_t* col);
+void blit_1bpp(rectangle r, const uint8_t* bits, const uint16_t* palette);
+void blit_4bpp(rectangle r, const uint8_t* px, const uint16_t* palette);
 void display_char(char c, uint16_t col);
 void display_char_xy(char c, uint16_t x, uint16_t y, uint16_t col);
+void display_char_clip_xy(char c, uint16_t x, uint16_t y, uint8_t rows, uint16_t col);
+void display_text_run(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg);
 void display_string(char *str, uint16_t col);
 void display_string_xy(const char *str, uint16_t x, uint16_t y, uint16_t col);
+
+#endif /* LCD_H */
@@ -0,0 +1,173 @@
+#include <avr/io.h>
+#include <stdlib.h>
+#include "ili934x.h"
+#include "lcd.h"
+#include "lcd_bench.h"
+
+#ifdef LCD_BENCH
+
+/* Shared by the benchmarks that draw from SRAM: a 16x16 block of pixels. */
+static uint16_t bench_buffer[16 * 16];
+
+static const uint16_t bench_palette[16] = {
+    BLACK, WHITE, BLUE, GREEN, CYAN, RED, MAGENTA, YELLOW,
+    BLACK, WHITE, BLUE, GREEN, CYAN, RED, MAGENTA, YELLOW
+};
+
+/*
+ * fill_rectangle() and fill_rectangle_indexed() as they were before they
+ * were unrolled, timed alongside them so that a run shows what it bought.
+ */
+static void baseline_fill_rectangle(rectangle r, uint16_t col)
+{
+    write_cmd(COLUMN_ADDRESS_SET);
+    write_data16(r.left);
+    write_data16(r.right);
+    write_cmd(PAGE_ADDRESS_SET);
+    write_data16(r.top);
+    write_data16(r.bottom);
+    write_cmd(MEMORY_WRITE);
+    uint16_t wpixels = r.right - r.left + 1;
+    uint16_t hpixels = r.bottom - r.top + 1;
+    uint8_t mod8, div8;
+    uint16_t odm8, odd8;
+    if (hpixels > wpixels) {
+        mod8 = hpixels & 0x07;
+        div8 = hpixels >> 3;
+        odm8 = wpixels*mod8;
+        odd8 = wpixels*div8;
+    } else {
+        mod8 = wpixels & 0x07;
+        div8 = wpixels >> 3;
+        odm8 = hpixels*mod8;
+        odd8 = hpixels*div8;
+    }
+    uint8_t pix1 = odm8 & 0x07;
+    while(pix1--)
+        write_data16(col);
+
+    uint16_t pix8 = odd8 + (odm8 >> 3);
+    while(pix8--) {
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+        write_data16(col);
+    }
+}
+
+static void baseline_fill_rectangle_indexed(rectangle r, uint16_t* col)
+{
+    uint16_t x, y;
+    write_cmd(COLUMN_ADDRESS_SET);
+    write_data16(r.left);
+    write_data16(r.right);
+    write_cmd(PAGE_ADDRESS_SET);
+    write_data16(r.top);
+    write_data16(r.bottom);
+    write_cmd(MEMORY_WRITE);
+    for(x=r.left; x<=r.right; x++)
+        for(y=r.top; y<=r.bottom; y++)
+            write_data16(*col++);
+}
+
+static void start_timer(void)
+{
+    TCCR1A = 0;
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);  /* cleared by writing a one */
+    TCCR1B = _BV(CS12);
+}
+
+/* Returns 0 if the timer overflowed. */
+static uint16_t stop_timer(void)
+{
+    uint16_t ticks = TCNT1;
+    TCCR1B = 0;
+
+    if (TIFR1 & _BV(TOV1))
+        return 0;
+
+    return ticks ? ticks : 1;
+}
+
+static void report(const char* name, uint32_t pixels, uint16_t ticks)
+{
+    char number[11];
+
+    display_string((char*) name, WHITE);
+
+    if (ticks == 0) {
+        display_string("too slow", YELLOW);
+    } else {
+        /* In kpx/s; F_CPU / 256 / 1000 is not a whole number of ticks. */
+        ultoa(pixels * (LCD_BENCH_TIMER_HZ / 250) / (4UL * ticks), number, 10);
+        display_string(number, YELLOW);
+        display_string(" kpx/s", WHITE);
+    }
+
+    display.x = 0;
+    display.y += FONT_WIDTH;
+}
+
+void run_lcd_bench(void)
+{
+    rectangle screen = {0, display.width - 1, 0, display.height - 1};
+    /* Drawn under the report. */
+    rectangle block = {0, 15, 200, 215};
+    rectangle row = {0, 19 * FONT_HEIGHT - 1, 220, 220 + FONT_WIDTH - 1};
+    const char* text = "The quick brown fox";
+    uint16_t ticks, baseline, j;
+    uint8_t i;
+
+    start_timer();
+    baseline_fill_rectangle(screen, BLACK);
+    baseline = stop_timer();
+
+    start_timer();
+    fill_rectangle(screen, BLACK);
+    ticks = stop_timer();
+    display.x = 0;
+    display.y = 0;
+    report("clear old ", (uint32_t) display.width * display.height, baseline);
+    report("clear     ", (uint32_t) display.width * display.height, ticks);
+
+    for(j=0; j<16 * 16; j++)
+        bench_buffer[j] = bench_palette[j % 16];
+    start_timer();
+    for(i=0; i<LCD_BENCH_PASSES; i++)
+        baseline_fill_rectangle_indexed(block, bench_buffer);
+    ticks = stop_timer();
+    report("pixels old", 16 * 16 * (uint32_t) LCD_BENCH_PASSES, ticks);
+
+    start_timer();
+    for(i=0; i<LCD_BENCH_PASSES; i++)
+        fill_rectangle_indexed(block, bench_buffer);
+    ticks = stop_timer();
+    report("pixels    ", 16 * 16 * (uint32_t) LCD_BENCH_PASSES, ticks);
+
+    /* The same buffer, read as packed bits and nibbles. */
+    start_timer();
+    for(i=0; i<LCD_BENCH_PASSES; i++)
+        blit_1bpp(block, (const uint8_t*) bench_buffer, bench_palette);
+    ticks = stop_timer();
+    report("1bpp      ", 16 * 16 * (uint32_t) LCD_BENCH_PASSES, ticks);
+
+    start_timer();
+    for(i=0; i<LCD_BENCH_PASSES; i++)
+        blit_4bpp(block, (const uint8_t*) bench_buffer, bench_palette);
+    ticks = stop_timer();
+    report("4bpp      ", 16 * 16 * (uint32_t) LCD_BENCH_PASSES, ticks);
+
+    start_timer();
+    for(i=0; i<LCD_BENCH_PASSES; i++)
+        display_text_run(text, 19, row, WHITE, BLACK);
+    ticks = stop_timer();
+    report("text run  ", (uint32_t) (row.right - row.left + 1)
+           * (row.bottom - row.top + 1) * LCD_BENCH_PASSES, ticks);
+}
+
+#endif /* LCD_BENCH */
@@ -0,0 +1,28 @@
+/*
+ * Throughput benchmark of the LCD drawing primitives.
+ *
+ * Each primitive is timed with Timer 1 and its rate in thousands of pixels
+ * per second is written on the screen. The clear and the pixel stream are
+ * also timed as they were before being unrolled, on the line above. Built
+ * into the firmware in place of the game when LCD_BENCH is defined, with
+ * interrupts still disabled so that nothing else runs on the bus.
+ */
+
+#ifndef LCD_BENCH_H
+#define LCD_BENCH_H
+
+#include <stdint.h>
+
+/*
+ * Timer 1 ticks at F_CPU / 256, so that it takes about 2 s to overflow: long
+ * enough for all LCD_BENCH_PASSES of a benchmark down to some 75 kpx/s.
+ * Benchmarks that take longer are reported as such rather than timed.
+ */
+#define LCD_BENCH_TIMER_HZ (F_CPU / 256)
+
+/* Passes over the small buffers, so that they are timed over enough pixels. */
+#define LCD_BENCH_PASSES 64
+
+void run_lcd_bench(void);
+
+#endif /* LCD_BENCH_H */
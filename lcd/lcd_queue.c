@@ -0,0 +1,217 @@
+#include <stddef.h>
+#include "lcd_queue.h"
+
+typedef enum {fill_command, run_command} command_type;
+
+typedef struct command {
+    command_type type;
+    rectangle r;
+    uint16_t fg, bg;
+    uint8_t length;
+    char text[LCD_RUN_MAX];
+} command;
+
+command commands[LCD_QUEUE_SIZE];
+uint8_t commands_first = 0;
+uint8_t commands_size = 0;
+
+command* queued_command(uint8_t i) {
+    return &commands[(commands_first + i) % LCD_QUEUE_SIZE];
+}
+
+uint8_t covers(rectangle outer, rectangle inner) {
+    return outer.left <= inner.left && outer.right >= inner.right
+        && outer.top <= inner.top && outer.bottom >= inner.bottom;
+}
+
+uint8_t overlaps(rectangle a, rectangle b) {
+    return a.left <= b.right && b.left <= a.right
+        && a.top <= b.bottom && b.top <= a.bottom;
+}
+
+/*
+ * Whether <a> and <b> together make up a rectangle: they have the same rows
+ * and touch or overlap across them, or the other way round. Stores it in
+ * <merged> if they do.
+ */
+uint8_t merge_rectangles(rectangle a, rectangle b, rectangle* merged) {
+    if (a.top == b.top && a.bottom == b.bottom
+        && a.left <= b.right + 1 && b.left <= a.right + 1) {
+        *merged = a;
+        merged->left = a.left < b.left ? a.left : b.left;
+        merged->right = a.right > b.right ? a.right : b.right;
+        return 1;
+    }
+
+    if (a.left == b.left && a.right == b.right
+        && a.top <= b.bottom + 1 && b.top <= a.bottom + 1) {
+        *merged = a;
+        merged->top = a.top < b.top ? a.top : b.top;
+        merged->bottom = a.bottom > b.bottom ? a.bottom : b.bottom;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Drop the queued commands that <r> paints over completely, whatever is
+ * queued between them and the new command.
+ */
+void drop_covered(rectangle r) {
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0; i < commands_size; ++i) {
+        if (covers(r, queued_command(i)->r))
+            continue;
+
+        if (kept != i)
+            *queued_command(kept) = *queued_command(i);
+        kept++;
+    }
+
+    commands_size = kept;
+}
+
+/*
+ * Grow a queued fill of the same colour into <r> if the two make up a
+ * rectangle. The fill is drawn earlier than <r> would have been, so nothing
+ * queued after it may overlap <r>.
+ */
+uint8_t merge_fill(rectangle r, uint16_t col) {
+    for (uint8_t i = commands_size; i-- > 0; ) {
+        command* c = queued_command(i);
+        rectangle merged;
+
+        if (c->type == fill_command && c->fg == col
+            && merge_rectangles(c->r, r, &merged)) {
+            c->r = merged;
+            return 1;
+        }
+
+        if (overlaps(c->r, r))
+            return 0;
+    }
+
+    return 0;
+}
+
+/* Make room for a new command. Returns NULL if the queue is full. */
+command* push_command(rectangle r) {
+    if (commands_size == LCD_QUEUE_SIZE)
+        return NULL;
+
+    command* c = queued_command(commands_size++);
+    c->r = r;
+    return c;
+}
+
+uint8_t queue_fill(rectangle r, uint16_t col) {
+    drop_covered(r);
+
+    if (merge_fill(r, col))
+        return 1;
+
+    command* c = push_command(r);
+    if (c == NULL)
+        return 0;
+
+    c->type = fill_command;
+    c->fg = col;
+    return 1;
+}
+
+uint8_t queue_text_run(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg) {
+    if (length > LCD_RUN_MAX)
+        length = LCD_RUN_MAX;
+
+    drop_covered(r);
+
+    command* c = push_command(r);
+    if (c == NULL)
+        return 0;
+
+    c->type = run_command;
+    c->fg = fg;
+    c->bg = bg;
+
+    uint8_t n;
+    for (n = 0; n < length && str[n]; ++n)
+        c->text[n] = str[n];
+    c->length = n;
+    return 1;
+}
+
+uint8_t queue_recolour(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg) {
+    for (uint8_t i = 0; i < commands_size; ++i) {
+        command* c = queued_command(i);
+
+        if (c->type == run_command
+            && c->r.left == r.left && c->r.right == r.right
+            && c->r.top == r.top && c->r.bottom == r.bottom) {
+            c->fg = fg;
+            c->bg = bg;
+            return 1;
+        }
+    }
+
+    return queue_text_run(str, length, r, fg, bg);
+}
+
+/* Columns of a fill of <height> rows that make up about <budget> pixels. */
+static uint16_t fill_columns(rectangle r, uint16_t budget) {
+    uint16_t width = r.right - r.left + 1;
+    uint16_t columns = budget / (r.bottom - r.top + 1);
+
+    if (columns == 0)
+        columns = 1;
+
+    return columns < width ? columns : width;
+}
+
+uint8_t peek_lcd_queue(rectangle* r, uint16_t budget) {
+    if (commands_size == 0)
+        return 0;
+
+    command* c = queued_command(0);
+    *r = c->r;
+
+    if (c->type == fill_command)
+        r->right = r->left + fill_columns(c->r, budget) - 1;
+
+    return 1;
+}
+
+uint32_t draw_lcd_command(uint16_t budget) {
+    rectangle r;
+    if (!peek_lcd_queue(&r, budget))
+        return 0;
+
+    command* c = queued_command(0);
+    uint32_t pixels = (uint32_t) (r.right - r.left + 1) * (r.bottom - r.top + 1);
+
+    if (c->type == fill_command) {
+        fill_rectangle(r, c->fg);
+
+        /* The rest of a large fill stays at the front of the queue. */
+        c->r.left = r.right + 1;
+        if (c->r.left <= c->r.right)
+            return pixels;
+    } else {
+        display_text_run(c->text, c->length, c->r, c->fg, c->bg);
+    }
+
+    commands_first = (commands_first + 1) % LCD_QUEUE_SIZE;
+    commands_size--;
+
+    return pixels;
+}
+
+uint8_t drain_lcd_queue(uint16_t budget) {
+    while (commands_size != 0 && budget != 0) {
+        uint32_t pixels = draw_lcd_command(budget);
+        budget = pixels < budget ? budget - pixels : 0;
+    }
+
+    return commands_size != 0;
+}
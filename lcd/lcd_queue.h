@@ -0,0 +1,51 @@
+/*
+ * Queue of drawing commands for the LCD.
+ *
+ * Drawing code queues fills and text runs instead of writing them to the
+ * display straight away, and a single task drains the queue a command at a
+ * time. Commands that are completely painted over by a command
+ * queued after them are dropped before they reach the bus, and a fill that
+ * makes up a rectangle with a queued fill of the same colour is merged into
+ * it. Queueing never draws: a command that does not fit is refused, and the
+ * caller tries again once the queue has drained.
+ *
+ * The queue is not interrupt safe: commands must be queued from the task
+ * that drains it.
+ */
+
+#ifndef LCD_QUEUE_H
+#define LCD_QUEUE_H
+
+#include <stdint.h>
+#include "lcd.h"
+
+#define LCD_QUEUE_SIZE 12
+#define LCD_RUN_MAX    (LCDHEIGHT / FONT_HEIGHT)  /* a run across the screen */
+
+/* These return 0 if the queue is full and the command was not queued. */
+uint8_t queue_fill(rectangle r, uint16_t col);
+uint8_t queue_text_run(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg);
+
+/*
+ * Changes the colours of a run of text. If a run over the same rectangle is
+ * still queued only its colours are changed, otherwise a new run is queued.
+ */
+uint8_t queue_recolour(const char *str, uint8_t length, rectangle r, uint16_t fg, uint16_t bg);
+
+/*
+ * The area the next call to draw_lcd_command() with the same <budget> draws.
+ * Fills of more than <budget> pixels are drawn a strip of columns at a time.
+ * Returns 0 if the queue is empty.
+ */
+uint8_t peek_lcd_queue(rectangle* r, uint16_t budget);
+
+/* Draws the next command, or the next strip of a fill. Returns its pixels. */
+uint32_t draw_lcd_command(uint16_t budget);
+
+/*
+ * Draws queued commands until about <budget> pixels have been written.
+ * Returns 0 once the queue is empty.
+ */
+uint8_t drain_lcd_queue(uint16_t budget);
+
+#endif /* LCD_QUEUE_H */
@@ -0,0 +1,74 @@
+#include "line_cache.h"
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+typedef struct cached_line {
+    uint16_t file_id; /* 0 if the entry is unused. */
+    char text[MAX_LINE_SIZE];
+    uint8_t age;      /* Reads of other lines since. */
+} cached_line;
+
+static cached_line cached_lines[LINE_CACHE_SIZE];
+
+static cached_line* find_line(uint16_t file_id) {
+    for (uint8_t i = 0; i < LINE_CACHE_SIZE; ++i)
+        if (cached_lines[i].file_id == file_id)
+            return &cached_lines[i];
+
+    return NULL;
+}
+
+static void touch(cached_line* line) {
+    for (uint8_t i = 0; i < LINE_CACHE_SIZE; ++i)
+        if (cached_lines[i].age != UINT8_MAX)
+            cached_lines[i].age++;
+
+    line->age = 0;
+}
+
+uint8_t line_cache_get(uint16_t file_id, char* buf) {
+    uint8_t sreg = SREG;
+    cli();
+
+    cached_line* line = find_line(file_id);
+    if (line != NULL) {
+        strcpy(buf, line->text);
+        touch(line);
+    }
+
+    SREG = sreg;
+    return line != NULL;
+}
+
+void line_cache_put(uint16_t file_id, const char* line) {
+    uint8_t sreg = SREG;
+    cli();
+
+    /* Another task may have cached it while this one was reading it. */
+    if (find_line(file_id) != NULL) {
+        SREG = sreg;
+        return;
+    }
+
+    /* Unused entries are the oldest of all. */
+    cached_line* oldest = &cached_lines[0];
+    for (uint8_t i = 0; i < LINE_CACHE_SIZE; ++i) {
+        cached_line* entry = &cached_lines[i];
+
+        if (entry->file_id == 0) {
+            oldest = entry;
+            break;
+        }
+
+        if (entry->age > oldest->age)
+            oldest = entry;
+    }
+
+    oldest->file_id = file_id;
+    strncpy(oldest->text, line, MAX_LINE_SIZE - 1);
+    oldest->text[MAX_LINE_SIZE - 1] = '\0';
+    touch(oldest);
+
+    SREG = sreg;
+}
@@ -0,0 +1,27 @@
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include <stdint.h>
+#include "dialogue.h"
+
+/*
+ * The dialogue lines read last, kept in SRAM so that reading one again does
+ * not go back to storage and unpack it. Lines are keyed by the ID of their
+ * file. The dialogue is never written during play, so nothing cached goes
+ * stale.
+ */
+
+/*
+ * Lines read to be logged: greetings, which come back whenever an interaction
+ * is entered again, and the lines of the answers given last. The options on
+ * screen are kept by the text box itself.
+ */
+#define LINE_CACHE_SIZE 4
+
+/* Copy the line of <file_id> into <buf> if cached. Returns 1 if it was. */
+uint8_t line_cache_get(uint16_t file_id, char* buf);
+
+/* Cache <line>, in place of the least recently used one. */
+void line_cache_put(uint16_t file_id, const char* line);
+
+#endif /* LINE_CACHE_H */
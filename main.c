@@ -6,11 +6,26 @@
 #include "input.h"
 #include "interaction.h"
 #include "OSFS.h"
+#include "frame.h"
+#include "lcd_bench.h"
+#include "eeprom_check.h"
 
 #define ON_NPC   1
 #define ON_SCENE 2
 
+#define TARGET_FRAME_RATE 30
+
 uint8_t in_interaction = 0;
+uint8_t won = 0;
+
+/*
+ * The interaction whose options the text box should show. The game only
+ * updates these and the dialogue log, and queues a redraw, which runs in the
+ * next frame.
+ */
+interaction* dialogue = NULL;
+uint8_t dialogue_selected = NONE_SELECTED;
+uint8_t dialogue_options = 0;
 
 game_map map = { .matrix = {{"########",
                              "#......#",
@@ -57,6 +72,8 @@ void on_switch(direction dir);
 void on_center();
 void on_win();
 uint8_t compute_next_index(uint8_t showing, size_t size, int8_t delta);
+void redraw_map();
+void redraw_text();
 
 void main() {
     os_init_scheduler();
@@ -64,17 +81,34 @@ void main() {
     initialize_input();
     os_add_task(check_switches, 100, 1);
     os_add_task(collect_delta, 500, 1);
+    os_add_task(flush_frames, 5, 0);
 
-    format();
+    mount_dialogue();
     initialize_interactions();
     initialize_display();
-    draw_game_map(&map);
+#ifdef LCD_BENCH
+    run_lcd_bench();
+    while(1);
+#endif
+#ifdef EEPROM_CHECK
+    run_eeprom_check();
+    while(1);
+#endif
+    init_frame_pacing(TARGET_FRAME_RATE);
+    queue_frame_update(redraw_map);
 
     sei();
     while(1);
 }
 
 int check_switches(int state) {
+    if (won)
+        return state;
+
+    /* Presses stay latched until the frame reading the card is done. */
+    if (dialogue_busy())
+        return state;
+
     if (get_switch_press(_BV(SWC)) && in_interaction)
         on_center();
 
@@ -96,25 +130,21 @@ int check_switches(int state) {
 int collect_delta(int state) {
     int8_t delta = enc_delta();
 
-    if (in_interaction && delta != 0) {
-        char on = map.matrix[map.player.z][map.player.y][map.player.x];
-        interaction* inter = on == '?'
-                             ? find_interaction_by_pos(map.player)
-                             : find_interaction_by_char(on);
-
-        if (inter->size_options == 0)
-            return state;
+    if (delta == 0)
+        return state;
 
-        clear_text_box();
+    uint8_t shown = dialogue != NULL ? count_options(shown_options(dialogue)) : 0;
 
+    if (in_interaction && dialogue_options && shown != 0) {
         /* Calculate the new index of the question. */
-        uint8_t new_index = compute_next_index(inter->showing,
-                inter->size_options, delta);
-
-        /* Rewrite the dialogue with a new selected index. */
-        write_interaction(inter, inter->current_line, new_index, 1);
+        dialogue_selected = compute_next_index(dialogue_selected, shown, delta);
+    } else {
+        /* Without options to pick from, the wheel scrolls the dialogue log. */
+        scroll_text_box(delta);
     }
 
+    queue_frame_update(redraw_text);
+
     return state;
 }
 
@@ -122,15 +152,12 @@ void on_switch(direction dir) {
     /* Move the player in memory. */
     move_to move_res = move_player(&map, dir);
     in_interaction = 0;
+    dialogue = NULL;
 
-    /* Clear the screen. */
-    clear_game_map();
-    clear_text_box();
+    /* Repaint the cells of the game map 'box' that changed. */
+    queue_frame_update(redraw_map);
 
-    /* Draw in the game map 'box'. */
-    draw_game_map(&map);
-
-    /* Draw the dialogue text if any. */
+    /* Show the dialogue text if any. */
     if (move_res.allowed) {
         interaction* inter = move_res.on == '?'
                              ? find_interaction_by_pos(map.player)
@@ -138,21 +165,26 @@ void on_switch(direction dir) {
 
         if (inter != NULL) {
             in_interaction = inter->type == npc ? ON_NPC : ON_SCENE;
-            uint8_t index = inter->size_options == 0 ? NONE_SELECTED : 0;
             char greet[MAX_LINE_SIZE];
             get_greet_line(greet, inter);
-            write_interaction(inter, greet, index, 1);
+            log_to_text_box(greet, WHITE);
+
+            dialogue = inter;
+            dialogue_selected = shown_options(inter) == 0 ? NONE_SELECTED : 0;
+            dialogue_options = 1;
         }
     } else {
         switch (move_res.on) {
             case '#':
-                write_to_text_box("That's a wall, detective.", WHITE);
+                log_to_text_box("That's a wall, detective.", WHITE);
                 break;
             case '=':
-                write_to_text_box("A locked door; you might need a key.", WHITE);
+                log_to_text_box("A locked door; you might need a key.", WHITE);
                 break;
         }
     }
+
+    queue_frame_update(redraw_text);
 }
 
 void on_center() {
@@ -164,28 +196,41 @@ void on_center() {
                          ? find_interaction_by_pos(map.player)
                          : find_interaction_by_char(on);
 
-    uint8_t selected = inter->showing;
+    /* The number of the option picked among all of them, shown or not. */
+    uint8_t selected = shown_option(shown_options(inter), dialogue_selected);
 
-    if (on == 'C' && selected == 2)
+    if (on == 'C' && selected == 2) {
         on_win();
+        return;
+    }
+
+    /* Log what the detective said, and then the answer to it. */
+    if (selected < inter->size_options) {
+        char player[MAX_LINE_SIZE];
+        get_player_line(player, inter, selected);
+        log_to_text_box(player, YELLOW);
+    }
 
     uint8_t show_options = 1;
     if (inter->type == scene && inter->on_select_option != NULL)
         show_options = inter->on_select_option(&map, selected);
 
+    char world[MAX_LINE_SIZE] = "";
+    get_world_line(world, inter, selected);
+    log_to_text_box(world, WHITE);
 
-    clear_game_map();
-    clear_text_box();
+    dialogue = inter;
+    dialogue_options = show_options;
 
-    draw_game_map(&map);
-    char world[MAX_LINE_SIZE];
-    get_world_line(world, inter, selected);
-    write_interaction(inter, world, selected, show_options);
+    queue_frame_update(redraw_map);
+    queue_frame_update(redraw_text);
 }
 
 uint8_t compute_next_index(uint8_t showing, size_t size, int8_t delta) {
     uint8_t new_index;
-    if (delta > 0) {
+    if (showing >= size) {
+        new_index = 0;
+    } else if (delta > 0) {
         new_index = showing == size - 1 ? 0 : showing + 1;
     } else {
         new_index = showing == 0 ? size - 1 : showing - 1u;
@@ -195,11 +240,25 @@ uint8_t compute_next_index(uint8_t showing, size_t size, int8_t delta) {
 }
 
 void on_win() {
-    clear_text_box();
-    write_to_text_box("He's done it again! What a display of wit and tenacity!", YELLOW);
-    write_to_text_box("Thank you for playing.", WHITE);
+    won = 1;
+    in_interaction = 0;
+    dialogue = NULL;
 
-    while(1);
+    log_to_text_box("He's done it again! What a display of wit and tenacity!", YELLOW);
+    log_to_text_box("Thank you for playing.", WHITE);
+
+    queue_frame_update(redraw_text);
+}
+
+/* What does not fit in the LCD queue is drawn in the next frame. */
+void redraw_map() {
+    if (!draw_game_map(&map))
+        queue_frame_update(redraw_map);
+}
+
+void redraw_text() {
+    set_text_box_options(dialogue_options ? dialogue : NULL, dialogue_selected);
 
-    cli();
+    if (!draw_text_box())
+        queue_frame_update(redraw_text);
 }
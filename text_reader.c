@@ -0,0 +1,65 @@
+#include "text_reader.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+/* Host builds, such as "make host-sd", keep the pairs in RAM. */
+#define PROGMEM
+#define pgm_read_byte(address) (*(address))
+#endif
+
+#define FIRST_CODE 0x80
+
+static const uint8_t pairs[][2] PROGMEM = DIALOGUE_PAIRS;
+
+result open_text(text_reader* reader, const osfsVolume* vol, uint16_t file_id) {
+    reader->chunk_size = 0;
+    reader->chunk_next = 0;
+    reader->pending_size = 0;
+    reader->left = 0;
+
+    return getFileInfo(vol, file_id, &reader->address, &reader->left);
+}
+
+/* The next byte of the file, or 0 at its end. */
+static uint8_t next_byte(text_reader* reader) {
+    if (reader->chunk_next == reader->chunk_size) {
+        if (reader->left == 0)
+            return 0;
+
+        uint8_t size = reader->left < TEXT_READER_CHUNK
+                       ? reader->left : TEXT_READER_CHUNK;
+
+        if (readNBytesChk(reader->address, size, reader->chunk) != NO_ERROR) {
+            reader->left = 0;
+            return 0;
+        }
+
+        reader->address += size;
+        reader->left -= size;
+        reader->chunk_size = size;
+        reader->chunk_next = 0;
+    }
+
+    return reader->chunk[reader->chunk_next++];
+}
+
+char read_text_char(text_reader* reader) {
+    uint8_t symbol = reader->pending_size != 0
+                     ? reader->pending[--reader->pending_size]
+                     : next_byte(reader);
+
+    /* A pair stands for its first symbol followed by its second. */
+    while (symbol >= FIRST_CODE) {
+        uint8_t code = symbol - FIRST_CODE;
+
+        /* Codes the pairs do not have are not text; they end it. */
+        if (code >= DIALOGUE_PAIR_COUNT)
+            return '\0';
+
+        reader->pending[reader->pending_size++] = pgm_read_byte(&pairs[code][1]);
+        symbol = pgm_read_byte(&pairs[code][0]);
+    }
+
+    return (char) symbol;
+}
@@ -0,0 +1,35 @@
+#ifndef TEXT_READER_H
+#define TEXT_READER_H
+
+#include <stdint.h>
+#include "OSFS.h"
+#include "dialogue_packed.h"
+
+/*
+ * Streams the text of a dialogue file a character at a time, reading the
+ * file a few bytes at a time and expanding the pairs it was packed with (see
+ * tools/pack_dialogue.py) on the way. Bytes below 0x80 are plain ASCII, left
+ * as they are by the packing.
+ *
+ * A reader keeps the address of its file, so the volume must not be written
+ * or compacted while one is open, such as from a task preempting the reader.
+ */
+
+#define TEXT_READER_CHUNK 8
+
+typedef struct text_reader {
+    uint16_t address;  /* Of the bytes after the chunk. */
+    uint16_t left;     /* Bytes of the file after the chunk. */
+    uint8_t chunk[TEXT_READER_CHUNK];
+    uint8_t chunk_size;
+    uint8_t chunk_next;
+    uint8_t pending[DIALOGUE_PAIR_DEPTH + 1];  /* Symbols still to expand. */
+    uint8_t pending_size;
+} text_reader;
+
+result open_text(text_reader* reader, const osfsVolume* vol, uint16_t file_id);
+
+/* The next character of the text, or '\0' once all of it has been read. */
+char read_text_char(text_reader* reader);
+
+#endif /* TEXT_READER_H */
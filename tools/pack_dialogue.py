@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Compress the dialogue of dialogue.h for the volume image in flash.
+
+The lines are byte pair encoded: the most common pair of adjacent symbols in
+all of them is replaced by a new code, again and again, for as long as a pair
+is used more than once and codes are left. Codes are the bytes from 0x80 up,
+so the ASCII text that is left, and any line stored uncompressed, is read as
+is. The pairs end up in flash, and the encoded lines in the OSFS volume that
+dialogue.c lays out in flash, or in a content pack on an SD card.
+
+Usage: pack_dialogue.py dialogue.h dialogue_packed.h
+"""
+
+import ast
+import re
+import sys
+
+FIRST_CODE = 0x80
+MAX_CODES = 0x80
+
+# Deeper pairs need more room in the decoder to expand.
+MAX_DEPTH = 8
+
+
+def parse_dialogue(header):
+    """Return the (field, file ID, text) entries of DIALOGUE_FILES."""
+    match = re.search(r'#define DIALOGUE_FILES\(X\)((?:.*\\\n)*.*\n)', header)
+    if match is None:
+        sys.exit("DIALOGUE_FILES not found")
+
+    # Lines are read into buffers of MAX_LINE_SIZE, null character included.
+    size = re.search(r'#define MAX_LINE_SIZE (\d+)', header)
+    if size is None:
+        sys.exit("MAX_LINE_SIZE not found")
+    max_length = int(size.group(1)) - 1
+
+    entries = []
+    for line in match.group(1).splitlines():
+        line = line.strip().rstrip('\\').strip()
+        if not line.startswith('X('):
+            continue
+
+        # The file ID is an expression, possibly with commas of its own.
+        body = line[2:line.rindex(')')]
+        field, rest = body.split(',', 1)
+        depth = 0
+        for i, c in enumerate(rest):
+            if c == '(':
+                depth += 1
+            elif c == ')':
+                depth -= 1
+            elif c == ',' and depth == 0:
+                break
+
+        text = ast.literal_eval(rest[i + 1:].strip())
+        if any(ord(c) >= FIRST_CODE for c in text):
+            sys.exit("%s: only ASCII can be packed" % field.strip())
+        if len(text) > max_length:
+            sys.exit("%s: longer than MAX_LINE_SIZE allows" % field.strip())
+
+        entries.append((field.strip(), rest[:i].strip(), text))
+
+    return entries
+
+
+def count_pairs(lines, depths):
+    counts = {}
+    for line in lines:
+        i = 0
+        while i < len(line) - 1:
+            pair = (line[i], line[i + 1])
+            if max(depths.get(s, 0) for s in pair) < MAX_DEPTH:
+                counts[pair] = counts.get(pair, 0) + 1
+            # "aaa" holds one pair "aa", not two.
+            i += 2 if i + 2 < len(line) and line[i + 2] == line[i] == line[i + 1] else 1
+    return counts
+
+
+def replace_pair(line, pair, code):
+    out = []
+    i = 0
+    while i < len(line):
+        if i < len(line) - 1 and (line[i], line[i + 1]) == pair:
+            out.append(code)
+            i += 2
+        else:
+            out.append(line[i])
+            i += 1
+    return out
+
+
+def pack(texts):
+    lines = [[ord(c) for c in text] for text in texts]
+    pairs = []
+    depths = {}
+
+    while len(pairs) < MAX_CODES:
+        counts = count_pairs(lines, depths)
+        if not counts:
+            break
+
+        # Ties go to the pair seen first, so that the output is stable.
+        pair = max(counts, key=counts.get)
+        if counts[pair] < 2:
+            break
+
+        code = FIRST_CODE + len(pairs)
+        pairs.append(pair)
+        depths[code] = 1 + max(depths.get(s, 0) for s in pair)
+        lines = [replace_pair(line, pair, code) for line in lines]
+
+    return pairs, lines, max(depths.values(), default=0)
+
+
+def unpack(pairs, line):
+    text = ''
+    for s in line:
+        text += chr(s) if s < FIRST_CODE else unpack(pairs, pairs[s - FIRST_CODE])
+    return text
+
+
+def c_string(symbols):
+    out = '"'
+    for s in symbols:
+        c = chr(s)
+        if s >= FIRST_CODE or not c.isprintable():
+            out += '\\%03o' % s
+        elif c in '"\\':
+            out += '\\' + c
+        elif c == '?':
+            out += '\\?'  # no trigraphs
+        else:
+            out += c
+    return out + '"'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip().splitlines()[-1])
+
+    with open(sys.argv[1]) as f:
+        entries = parse_dialogue(f.read())
+
+    pairs, lines, depth = pack([text for _, _, text in entries])
+    for (field, _, text), line in zip(entries, lines):
+        assert unpack(pairs, line) == text, field
+
+    before = sum(len(text) for _, _, text in entries)
+    after = sum(len(line) for line in lines)
+
+    out = []
+    out.append('/* Generated by tools/pack_dialogue.py from dialogue.h; do not edit. */')
+    out.append('')
+    out.append('#ifndef DIALOGUE_PACKED_H')
+    out.append('#define DIALOGUE_PACKED_H')
+    out.append('')
+    out.append('/* %d bytes of text packed into %d. */' % (before, after))
+    out.append('')
+    out.append('#define DIALOGUE_PAIR_COUNT %d' % len(pairs))
+    out.append('#define DIALOGUE_PAIR_DEPTH %d' % depth)
+    out.append('')
+    out.append('#define DIALOGUE_PAIRS { \\')
+    if not pairs:
+        out.append('    {0, 0}, \\')  # C has no empty arrays
+    for i in range(0, len(pairs), 8):
+        row = ', '.join('{%d, %d}' % p for p in pairs[i:i + 8])
+        out.append('    %s, \\' % row)
+    out.append('}')
+    out.append('')
+    out.append('#define DIALOGUE_PACKED(X) \\')
+    width = max(len(field) for field, _, _ in entries) + 1
+    id_width = max(len(file_id) for _, file_id, _ in entries) + 1
+    rows = ['    X(%s %s %s)' % ((field + ',').ljust(width), (file_id + ',').ljust(id_width), c_string(line))
+            for (field, file_id, _), line in zip(entries, lines)]
+    out.append(' \\\n'.join(rows))
+    out.append('')
+    out.append('#endif /* DIALOGUE_PACKED_H */')
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()